@@ -21,5 +21,8 @@ return {
   },
   blame = {
     heatmap = true
+  },
+  largefile = {
+    threshold = 8 * 1024 * 1024
   }
 }
@@ -10,6 +10,8 @@
 #include "TextEditor.h"
 #include "app/Application.h"
 #include "conf/Settings.h"
+#include <QCache>
+#include <QCryptographicHash>
 #include <QFocusEvent>
 #include <QMainWindow>
 #include <QStyle>
@@ -19,6 +21,31 @@ using namespace Scintilla;
 
 extern LexerModule lmLPeg;
 
+namespace {
+
+// The maximum number of cached style runs.
+const int kStyleCacheSize = 512 * 1024;
+
+// Large files are added to the document in chunks of this size.
+const int kLargeFileChunk = 1024 * 1024;
+
+struct StyleRun
+{
+  int length;
+  int style;
+};
+
+using StyleRuns = QVector<StyleRun>;
+
+// Styles are only touched on the main thread.
+QCache<QByteArray,StyleRuns> &styleCache()
+{
+  static QCache<QByteArray,StyleRuns> cache(kStyleCacheSize);
+  return cache;
+}
+
+} // anon. namespace
+
 TextEditor::TextEditor(QWidget *parent)
   : ScintillaIFace(parent)
 {
@@ -115,6 +142,11 @@ TextEditor::TextEditor(QWidget *parent)
           this, &TextEditor::applySettings);
 }
 
+TextEditor::~TextEditor()
+{
+  cacheStyles();
+}
+
 void TextEditor::applySettings()
 {
   // Set default font and size.
@@ -190,7 +222,7 @@ void TextEditor::applySettings()
 
 QString TextEditor::lexer() const
 {
-  return Settings::instance()->lexer(mPath);
+  return mLargeFile ? "null" : Settings::instance()->lexer(mPath);
 }
 
 void TextEditor::setLineCount(int lines)
@@ -206,9 +238,36 @@ void TextEditor::setLexer(const QString &path)
 
 void TextEditor::load(const QString &path, const QString &text)
 {
+  QByteArray utf8 = text.toUtf8();
+  load(path, utf8.constData(), utf8.length());
+}
+
+void TextEditor::load(const QString &path, const char *text, int length)
+{
+  cacheStyles();
+
+  Settings *settings = Settings::instance();
+  int threshold = settings->value("editor/largefile/threshold").toInt();
+  mLargeFile = (threshold > 0 && length > threshold);
+
   setScrollWidth(256);
   setLexer(path);
-  setText(text);
+  clearAll();
+
+  if (mLargeFile) {
+    // Avoid recording undo history for each chunk.
+    setUndoCollection(false);
+    allocate(length + 1);
+    for (int pos = 0; pos < length; pos += kLargeFileChunk) {
+      int chunk = qMin(kLargeFileChunk, length - pos);
+      send(SCI_APPENDTEXT, chunk, reinterpret_cast<sptr_t>(text + pos));
+    }
+
+    setUndoCollection(true);
+  } else {
+    send(SCI_APPENDTEXT, length, reinterpret_cast<sptr_t>(text));
+    restoreStyles();
+  }
 
   // Clear undo.
   setSavePoint();
@@ -218,6 +277,57 @@ void TextEditor::load(const QString &path, const QString &text)
   updateGeometry();
 }
 
+bool TextEditor::restoreStyles()
+{
+  if (length() == 0)
+    return false;
+
+  StyleRuns *runs = styleCache().object(styleKey());
+  if (!runs)
+    return false;
+
+  startStyling(0);
+  foreach (const StyleRun &run, *runs)
+    setStyling(run.length, run.style);
+
+  return true;
+}
+
+void TextEditor::cacheStyles()
+{
+  int length = this->length();
+  if (mLargeFile || length == 0 || endStyled() < length)
+    return;
+
+  QByteArray key = styleKey();
+  QCache<QByteArray,StyleRuns> &cache = styleCache();
+  if (cache.contains(key))
+    return;
+
+  StyleRuns *runs = new StyleRuns;
+  int start = 0;
+  int style = static_cast<uchar>(pdoc->StyleAt(0));
+  for (int pos = 1; pos < length; ++pos) {
+    int next = static_cast<uchar>(pdoc->StyleAt(pos));
+    if (next != style) {
+      runs->append({pos - start, style});
+      start = pos;
+      style = next;
+    }
+  }
+
+  runs->append({length - start, style});
+  cache.insert(key, runs, runs->size());
+}
+
+QByteArray TextEditor::styleKey() const
+{
+  QByteArray text = QByteArray::fromRawData(characterPointer(), length());
+  QByteArray hash = QCryptographicHash::hash(text, QCryptographicHash::Md5);
+  QByteArray theme = Application::theme()->name().toUtf8();
+  return lexer().toUtf8() + '\0' + theme + '\0' + hash;
+}
+
 void TextEditor::clearHighlights()
 {
   setIndicatorCurrent(FindAll);
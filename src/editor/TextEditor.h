@@ -80,6 +80,7 @@ public:
   };
 
   TextEditor(QWidget *parent = nullptr);
+  ~TextEditor() override;
 
   void applySettings();
 
@@ -89,6 +90,18 @@ public:
   void setLexer(const QString &path);
   void load(const QString &path, const QString &text);
 
+  // Load UTF-8 text without converting it. Text that is larger than the
+  // editor/largefile/threshold setting is added in chunks and not lexed.
+  void load(const QString &path, const char *text, int length);
+
+  // Style runs are shared between editors that show the same text with
+  // the same lexer and theme. Restore cached styles for the current text
+  // instead of lexing it. Return false if the text still has to be lexed.
+  bool restoreStyles();
+
+  // Cache styles of the current text once it has been completely lexed.
+  void cacheStyles();
+
   void clearHighlights();
   int highlightAll(const QString &text);
   int find(const QString &text, bool forward = true, bool indicator = true);
@@ -118,11 +131,14 @@ protected:
   QSize viewportSizeHint() const override;
 
 private:
+  QByteArray styleKey() const;
+
   int diagnosticMarker(int line);
   void loadMarkerIcon(Marker marker, const QIcon &icon);
 
   QString mPath;
   int mLineCount = -1;
+  bool mLargeFile = false;
 
   QColor mOursColor;
   QColor mTheirsColor;
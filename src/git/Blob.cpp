@@ -42,4 +42,10 @@ QByteArray Blob::content() const
   return QByteArray(content, git_blob_rawsize(*this));
 }
 
+QByteArray Blob::rawContent() const
+{
+  const char *content = static_cast<const char *>(git_blob_rawcontent(*this));
+  return QByteArray::fromRawData(content, git_blob_rawsize(*this));
+}
+
 } // namespace git
@@ -24,6 +24,10 @@ public:
   bool isBinary() const;
   QByteArray content() const;
 
+  // Get the content without copying it. The data
+  // is only valid as long as the blob is alive.
+  QByteArray rawContent() const;
+
 private:
   Blob(git_blob *blob);
   operator git_blob *() const;
@@ -0,0 +1,155 @@
+//
+//          Copyright (c) 2016, Scientific Toolworks, Inc.
+//
+// This software is licensed under the MIT License. The LICENSE.md file
+// describes the conditions under which this software may be distributed.
+//
+// Author: Jason Haslam
+//
+
+#include "BloomFilter.h"
+
+namespace git {
+
+namespace {
+
+const int kHashCount = 7;
+const int kBitsPerEntry = 10;
+const int kMinSize = 8;
+
+const quint32 kSeed1 = 0x293ae76f;
+const quint32 kSeed2 = 0x7e646e2c;
+
+quint32 rotl(quint32 value, int count)
+{
+  return (value << count) | (value >> (32 - count));
+}
+
+// MurmurHash3 (x86, 32-bit). This must not change.
+quint32 murmur3(const QByteArray &key, quint32 seed)
+{
+  const quint32 c1 = 0xcc9e2d51;
+  const quint32 c2 = 0x1b873593;
+
+  quint32 hash = seed;
+  int len = key.length();
+  const uchar *data = reinterpret_cast<const uchar *>(key.constData());
+
+  int blocks = len / 4;
+  for (int i = 0; i < blocks; ++i) {
+    const uchar *block = data + (i * 4);
+    quint32 k = block[0] | (block[1] << 8) | (block[2] << 16) |
+                (quint32(block[3]) << 24);
+
+    k *= c1;
+    k = rotl(k, 15);
+    k *= c2;
+
+    hash ^= k;
+    hash = rotl(hash, 13);
+    hash = (hash * 5) + 0xe6546b64;
+  }
+
+  quint32 k = 0;
+  const uchar *tail = data + (blocks * 4);
+  switch (len & 3) {
+    case 3: k ^= tail[2] << 16; // fall through
+    case 2: k ^= tail[1] << 8;  // fall through
+    case 1:
+      k ^= tail[0];
+      k *= c1;
+      k = rotl(k, 15);
+      k *= c2;
+      hash ^= k;
+  }
+
+  hash ^= len;
+  hash ^= hash >> 16;
+  hash *= 0x85ebca6b;
+  hash ^= hash >> 13;
+  hash *= 0xc2b2ae35;
+  hash ^= hash >> 16;
+
+  return hash;
+}
+
+QByteArray pathKey(const QString &path)
+{
+  QByteArray key = path.toUtf8();
+  while (key.endsWith('/'))
+    key.chop(1);
+  return key;
+}
+
+} // anon. namespace
+
+BloomFilter::BloomFilter() {}
+
+BloomFilter::BloomFilter(int count)
+  : mData(qMax(kMinSize, (count * kBitsPerEntry + 7) / 8), 0)
+{}
+
+BloomFilter::BloomFilter(const QByteArray &data)
+  : mData(data)
+{}
+
+void BloomFilter::insert(const QByteArray &key)
+{
+  quint32 bits = mData.size() * 8;
+  quint32 hash1 = murmur3(key, kSeed1);
+  quint32 hash2 = murmur3(key, kSeed2);
+  for (int i = 0; i < kHashCount; ++i) {
+    quint32 bit = (hash1 + i * hash2) % bits;
+    mData[bit / 8] = mData.at(bit / 8) | (1 << (bit % 8));
+  }
+}
+
+bool BloomFilter::contains(const QByteArray &key) const
+{
+  // An invalid filter can't rule anything out.
+  if (!isValid())
+    return true;
+
+  quint32 bits = mData.size() * 8;
+  quint32 hash1 = murmur3(key, kSeed1);
+  quint32 hash2 = murmur3(key, kSeed2);
+  for (int i = 0; i < kHashCount; ++i) {
+    quint32 bit = (hash1 + i * hash2) % bits;
+    if (!(mData.at(bit / 8) & (1 << (bit % 8))))
+      return false;
+  }
+
+  return true;
+}
+
+void BloomFilter::insertPath(const QString &path)
+{
+  QByteArray key = pathKey(path);
+  while (!key.isEmpty()) {
+    insert(key);
+
+    int index = key.lastIndexOf('/');
+    key.truncate(index >= 0 ? index : 0);
+  }
+}
+
+bool BloomFilter::containsPath(const QString &path) const
+{
+  return contains(pathKey(path));
+}
+
+BloomFilter BloomFilter::changedPaths(const QStringList &paths)
+{
+  // Count paths and their leading directories.
+  int count = 0;
+  foreach (const QString &path, paths)
+    count += path.count('/') + 1;
+
+  BloomFilter filter(count);
+  foreach (const QString &path, paths)
+    filter.insertPath(path);
+
+  return filter;
+}
+
+} // namespace git
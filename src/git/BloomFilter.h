@@ -0,0 +1,48 @@
+//
+//          Copyright (c) 2016, Scientific Toolworks, Inc.
+//
+// This software is licensed under the MIT License. The LICENSE.md file
+// describes the conditions under which this software may be distributed.
+//
+// Author: Jason Haslam
+//
+
+#ifndef BLOOMFILTER_H
+#define BLOOMFILTER_H
+
+#include <QByteArray>
+#include <QStringList>
+
+namespace git {
+
+// A probabilistic set of byte strings. Lookups may return false
+// positives but never false negatives. The hash functions are stable
+// so that filters can be written to disk and read back later.
+class BloomFilter
+{
+public:
+  BloomFilter();
+  BloomFilter(int count);
+  BloomFilter(const QByteArray &data);
+
+  bool isValid() const { return !mData.isEmpty(); }
+
+  QByteArray data() const { return mData; }
+
+  void insert(const QByteArray &key);
+  bool contains(const QByteArray &key) const;
+
+  // Changed path filters contain each path and all of its leading
+  // directories so that directory pathspecs can be tested too.
+  void insertPath(const QString &path);
+  bool containsPath(const QString &path) const;
+
+  static BloomFilter changedPaths(const QStringList &paths);
+
+private:
+  QByteArray mData;
+};
+
+} // namespace git
+
+#endif
@@ -19,18 +19,28 @@
 #include "conf/Settings.h"
 #include "git2/annotated_commit.h"
 #include "git2/diff.h"
+#include "git2/graph.h"
 #include "git2/refs.h"
 #include "git2/revert.h"
 #include <QDateTime>
 #include <QJsonArray>
 #include <QJsonDocument>
 #include <QJsonObject>
+#include <QMultiMap>
 #include <QRegularExpression>
 #include <QTextCodec>
 #include <QVector>
 
 namespace git {
 
+namespace {
+
+const QString kTagPrefix = "refs/tags/";
+
+const int kDescriptionLimit = 10000;
+
+} // anon. namespace
+
 QMap<QString,QString> Commit::sEmojiCache;
 
 Commit::Commit()
@@ -70,36 +80,71 @@ QString Commit::message(MessageOptions options) const
 }
 
 QString Commit::description() const
+{
+  Repository repo = this->repo();
+  int generation = 0;
+  QString description;
+  if (repo.lookupDescription(id(), description, generation))
+    return description;
+
+  // The result is dropped if refs change in the meantime.
+  description = findDescription(repo.refIndex());
+  repo.storeDescription(id(), description, generation);
+  return description;
+}
+
+QString Commit::findDescription(const QMultiHash<Id,QString> &refs) const
 {
   // Build list of candidates.
-  QHash<Id,TagRef> candidates;
-  foreach (const TagRef &tag, repo().tags()) {
-    if (Commit commit = tag.target())
-      candidates.insert(commit.id(), tag);
+  QHash<Id,QString> candidates;
+  QMultiHash<Id,QString>::const_iterator it;
+  for (it = refs.constBegin(); it != refs.constEnd(); ++it) {
+    if (it.value().startsWith(kTagPrefix))
+      candidates.insert(it.key(), it.value().mid(kTagPrefix.length()));
   }
 
   if (candidates.isEmpty())
     return QString();
 
   // Check for exact match.
-  auto it = candidates.constFind(id());
-  if (it != candidates.constEnd())
-    return it->name();
-
-  // Walk parents.
-  QList<Commit> commits = parents();
-  while (!commits.isEmpty()) {
-    QSet<Commit> parents;
-    foreach (const Commit &commit, commits) {
-      auto it = candidates.constFind(commit.id());
-      if (it != candidates.constEnd())
-        return QString("%1 +%2").arg(it->name()).arg(difference(commit));
-
-      foreach (const Commit &parent, commit.parents())
-        parents.insert(parent);
+  auto candidate = candidates.constFind(id());
+  if (candidate != candidates.constEnd())
+    return *candidate;
+
+  // Visit ancestors newest first so that the nearest tag on recent
+  // history is found without exploring old branches. Give up after
+  // a fixed number of commits.
+  QSet<Id> seen;
+  QMultiMap<QDateTime,Commit> queue;
+  foreach (const Commit &parent, parents()) {
+    if (!seen.contains(parent.id())) {
+      seen.insert(parent.id());
+      queue.insert(parent.committer().date(), parent);
+    }
+  }
+
+  int count = 0;
+  while (!queue.isEmpty() && count++ < kDescriptionLimit) {
+    auto last = queue.end() - 1;
+    Commit commit = last.value();
+    queue.erase(last);
+
+    candidate = candidates.constFind(commit.id());
+    if (candidate != candidates.constEnd()) {
+      size_t ahead = 0;
+      size_t behind = 0;
+      git_graph_ahead_behind(
+        &ahead, &behind, git_object_owner(d.data()),
+        git_object_id(d.data()), git_object_id(commit.d.data()));
+      return QString("%1 +%2").arg(*candidate).arg(ahead);
     }
 
-    commits = parents.toList();
+    foreach (const Commit &parent, commit.parents()) {
+      if (!seen.contains(parent.id())) {
+        seen.insert(parent.id());
+        queue.insert(parent.committer().date(), parent);
+      }
+    }
   }
 
   return QString();
@@ -133,7 +178,10 @@ Signature Commit::committer() const
   return const_cast<git_signature *>(git_commit_committer(*this));
 }
 
-Diff Commit::diff(const git::Commit &commit, int contextLines) const
+Diff Commit::diff(
+  const git::Commit &commit,
+  int contextLines,
+  Diff::Callbacks *callbacks) const
 {
   Tree old;
   if (commit.isValid()) {
@@ -146,6 +194,11 @@ Diff Commit::diff(const git::Commit &commit, int contextLines) const
 
   git_diff_options opts = GIT_DIFF_OPTIONS_INIT;
   opts.context_lines = contextLines;
+  if (callbacks) {
+    opts.notify_cb = &Diff::Callbacks::notify;
+    opts.progress_cb = &Diff::Callbacks::progress;
+    opts.payload = callbacks;
+  }
 
   git_diff *diff = nullptr;
   git_repository *repo = git_object_owner(d.data());
@@ -186,27 +239,14 @@ QList<Reference> Commit::refs() const
       refs.append(head);
   }
 
-  // Iterate over references.
-  git_reference_iterator *it = nullptr;
-  if (git_reference_iterator_new(&it, repo))
-    return QList<Reference>();
-
-  git_reference *ref = nullptr;
-  const git_oid *id = git_object_id(d.data());
-  while (!git_reference_next(&ref, it)) {
-    git_object *obj = nullptr;
-    if (!git_reference_peel(&obj, ref, GIT_OBJECT_COMMIT) &&
-        git_oid_equal(git_object_id(obj), id)) {
-      refs.append(Reference(ref));
-    } else {
-      git_reference_free(ref);
-    }
-
-    git_object_free(obj);
+  // Look up references in the index.
+  QStringList names = repo.refIndex().values(id());
+  std::sort(names.begin(), names.end());
+  foreach (const QString &name, names) {
+    if (Reference ref = repo.lookupRef(name))
+      refs.append(ref);
   }
 
-  git_reference_iterator_free(it);
-
   return refs;
 }
 
@@ -242,6 +282,13 @@ int Commit::difference(const Commit &commit) const
   return result;
 }
 
+bool Commit::isDescendantOf(const Commit &commit) const
+{
+  git_repository *repo = git_object_owner(d.data());
+  const git_oid *id = git_object_id(d.data());
+  return (git_graph_descendant_of(repo, id, commit.id()) == 1);
+}
+
 bool Commit::revert() const
 {
   Repository repo = this->repo();
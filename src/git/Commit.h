@@ -10,17 +10,18 @@
 #ifndef COMMIT_H
 #define COMMIT_H
 
+#include "Diff.h"
 #include "Object.h"
 #include "git2/commit.h"
 #include "git2/revwalk.h"
 #include "git2/reset.h"
+#include <QHash>
 
 class QDateTime;
 
 namespace git {
 
 class AnnotatedCommit;
-class Diff;
 class Reference;
 class RevWalk;
 class Signature;
@@ -51,11 +52,15 @@ public:
   Signature author() const;
   Signature committer() const;
 
-  Diff diff(const Commit &commit = git::Commit(), int contextLines = -1) const;
+  Diff diff(
+    const Commit &commit = git::Commit(),
+    int contextLines = -1,
+    Diff::Callbacks *callbacks = nullptr) const;
   Tree tree() const;
   QList<Commit> parents() const;
 
-  // Get refs that point to this commit.
+  // Get refs that point to this commit. A detached HEAD comes
+  // first and the rest are sorted by qualified name.
   QList<Reference> refs() const;
 
   // Create a walker starting from this commit.
@@ -65,6 +70,9 @@ public:
   // Commits that have diverged calculate the distance to a common base.
   int difference(const Commit &commit) const;
 
+  // Check if the given commit is reachable from this commit.
+  bool isDescendantOf(const Commit &commit) const;
+
   // Revert this commit in the index and workdir.
   bool revert() const;
 
@@ -84,6 +92,7 @@ private:
   Commit(git_commit *commit);
   operator git_commit *() const;
 
+  QString findDescription(const QMultiHash<Id,QString> &refs) const;
   QString decodeMessage(const char *msg) const;
   QString substituteEmoji(const QString &text) const;
 
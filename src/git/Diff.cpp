@@ -9,11 +9,243 @@
 
 #include "Diff.h"
 #include "Patch.h"
+#include "Repository.h"
+#include "git2/odb.h"
 #include "git2/patch.h"
+#include <QElapsedTimer>
+#include <QFile>
 #include <algorithm>
+#include <cctype>
 
 namespace git {
 
+namespace {
+
+// Keep the smallest distinct line hashes as a fixed size sketch.
+const int kSignatureSize = 128;
+
+// Read workdir files in chunks of this size.
+const qint64 kSignatureChunk = 64 * 1024;
+
+// A bottom-k sketch of the distinct hashes of lines with whitespace
+// removed. Lines that repeat, like braces, count only once. Otherwise
+// they could fill the sketch of unrelated files. Content can be added
+// in pieces.
+class Sketch
+{
+public:
+  void add(const char *data, size_t len)
+  {
+    for (size_t i = 0; i < len; ++i) {
+      char ch = data[i];
+      if (ch == '\n') {
+        append();
+      } else if (!isspace(static_cast<uchar>(ch))) {
+        // FNV-1a
+        mHash ^= static_cast<uchar>(ch);
+        mHash *= 16777619u;
+        mEmpty = false;
+      }
+    }
+  }
+
+  QVector<quint32> finish()
+  {
+    append();
+    compact();
+    return mHashes;
+  }
+
+private:
+  void append()
+  {
+    if (!mEmpty) {
+      mHashes.append(mHash);
+      if (mHashes.size() >= 8 * kSignatureSize)
+        compact();
+    }
+
+    mHash = 2166136261u;
+    mEmpty = true;
+  }
+
+  void compact()
+  {
+    std::sort(mHashes.begin(), mHashes.end());
+    mHashes.erase(std::unique(mHashes.begin(), mHashes.end()), mHashes.end());
+    if (mHashes.size() > kSignatureSize)
+      mHashes.resize(kSignatureSize);
+  }
+
+  QVector<quint32> mHashes;
+  quint32 mHash = 2166136261u;
+  bool mEmpty = true;
+};
+
+QVector<quint32> signature(const char *data, size_t len)
+{
+  Sketch sketch;
+  sketch.add(data, len);
+  return sketch.finish();
+}
+
+// Similarity metric for git_diff_find_similar. Signatures of blobs
+// are looked up by id in the repository cache before hashing. New
+// signatures are added to the cache when detection is complete. Files
+// that aren't hashed get an empty signature that never matches, so
+// libgit2 doesn't try to compute them again for every comparison.
+class Similarity
+{
+public:
+  Similarity(
+    const Repository &repo,
+    int timeout,
+    Diff::Callbacks *callbacks)
+    : mRepo(repo), mTimeout(timeout), mCallbacks(callbacks)
+  {
+    mTimer.start();
+  }
+
+  void store()
+  {
+    mRepo.addSimilaritySignatures(mSignatures);
+  }
+
+  bool isExpired() const { return mExpired; }
+
+  static int fileSignature(
+    void **out,
+    const git_diff_file *file,
+    const char *fullpath,
+    void *payload)
+  {
+    // Workdir content may differ from the blob
+    // after filtering, so it isn't cached.
+    Similarity *metric = reinterpret_cast<Similarity *>(payload);
+    *out = nullptr;
+    if (!metric->check(file))
+      return -1;
+
+    QFile dev(QString::fromUtf8(fullpath));
+    if (metric->expire() || !dev.open(QIODevice::ReadOnly)) {
+      *out = new QVector<quint32>;
+      return 0;
+    }
+
+    // Large files aren't read whole.
+    Sketch sketch;
+    QByteArray chunk = dev.read(kSignatureChunk);
+    while (!chunk.isEmpty()) {
+      if (metric->expire()) {
+        *out = new QVector<quint32>;
+        return 0;
+      }
+
+      sketch.add(chunk.constData(), chunk.size());
+      chunk = dev.read(kSignatureChunk);
+    }
+
+    *out = new QVector<quint32>(sketch.finish());
+    return 0;
+  }
+
+  static int bufferSignature(
+    void **out,
+    const git_diff_file *file,
+    const char *buf,
+    size_t buflen,
+    void *payload)
+  {
+    Similarity *metric = reinterpret_cast<Similarity *>(payload);
+    *out = nullptr;
+    if (!metric->check(file))
+      return -1;
+
+    Id id = (file->flags & GIT_DIFF_FLAG_VALID_ID) ? Id(file->id) : Id();
+    if (id.isValid()) {
+      QVector<quint32> cached;
+      if (metric->mRepo.lookupSimilaritySignature(id, cached)) {
+        *out = new QVector<quint32>(cached);
+        return 0;
+      }
+    }
+
+    if (metric->expire()) {
+      *out = new QVector<quint32>;
+      return 0;
+    }
+
+    QVector<quint32> *sig = new QVector<quint32>(signature(buf, buflen));
+    if (id.isValid())
+      metric->mSignatures.insert(id, *sig);
+
+    *out = sig;
+    return 0;
+  }
+
+  static void freeSignature(void *sig, void *payload)
+  {
+    delete reinterpret_cast<QVector<quint32> *>(sig);
+  }
+
+  static int similarity(int *score, void *siga, void *sigb, void *payload)
+  {
+    const QVector<quint32> &a = *reinterpret_cast<QVector<quint32> *>(siga);
+    const QVector<quint32> &b = *reinterpret_cast<QVector<quint32> *>(sigb);
+    if (a.isEmpty() || b.isEmpty()) {
+      *score = 0;
+      return 0;
+    }
+
+    // Count common hashes of the sorted sketches.
+    int common = 0;
+    auto i = a.constBegin();
+    auto j = b.constBegin();
+    while (i != a.constEnd() && j != b.constEnd()) {
+      if (*i < *j) {
+        ++i;
+      } else if (*j < *i) {
+        ++j;
+      } else {
+        ++common;
+        ++i;
+        ++j;
+      }
+    }
+
+    *score = (200 * common) / (a.size() + b.size());
+    return 0;
+  }
+
+private:
+  bool check(const git_diff_file *file) const
+  {
+    if (!mCallbacks)
+      return true;
+
+    QString path = QString::fromUtf8(file->path);
+    return mCallbacks->progress(path, path);
+  }
+
+  // Check the time budget. Remember if any file was skipped.
+  bool expire()
+  {
+    if (mTimeout > 0 && mTimer.hasExpired(mTimeout))
+      mExpired = true;
+    return mExpired;
+  }
+
+  Repository mRepo;
+  int mTimeout;
+  Diff::Callbacks *mCallbacks;
+
+  QElapsedTimer mTimer;
+  bool mExpired = false;
+  QHash<Id,QVector<quint32>> mSignatures;
+};
+
+} // anon. namespace
+
 int Diff::Callbacks::progress(
   const git_diff *diff,
   const char *oldPath,
@@ -24,6 +256,17 @@ int Diff::Callbacks::progress(
   return cbs->progress(oldPath, newPath) ? 0 : -1;
 }
 
+int Diff::Callbacks::notify(
+  const git_diff *diff,
+  const git_diff_delta *delta,
+  const char *pathspec,
+  void *payload)
+{
+  Diff::Callbacks *cbs = reinterpret_cast<Diff::Callbacks *>(payload);
+  cbs->delta(delta->new_file.path, delta->status);
+  return 0;
+}
+
 Diff::Data::Data(git_diff *diff)
   : diff(diff)
 {
@@ -38,6 +281,10 @@ Diff::Data::~Data()
 void Diff::Data::resetMap()
 {
   map.clear();
+  patches.clear();
+  if (!diff)
+    return;
+
   int count = git_diff_num_deltas(diff);
   for (int i = 0; i < count; ++i)
     map.append(i);
@@ -59,6 +306,25 @@ Diff::operator git_diff *() const
   return d->diff;
 }
 
+Diff Diff::pending()
+{
+  Diff diff;
+  diff.d.reset(new Data(nullptr));
+  return diff;
+}
+
+bool Diff::isPending() const
+{
+  return (d && !d->diff);
+}
+
+void Diff::append(const QString &name, git_delta_t status)
+{
+  Q_ASSERT(isPending());
+  QMutexLocker locker(&d->lock);
+  d->files.append({name, status});
+}
+
 bool Diff::isConflicted() const
 {
   int count = this->count();
@@ -72,37 +338,98 @@ bool Diff::isConflicted() const
 
 int Diff::count() const
 {
+  if (!d->diff) {
+    QMutexLocker locker(&d->lock);
+    return d->files.size();
+  }
+
   return git_diff_num_deltas(d->diff);
 }
 
 Patch Diff::patch(int index) const
 {
+  if (!d->diff)
+    return Patch();
+
+  int delta = d->map.at(index);
+  auto it = d->patches.constFind(delta);
+  if (it != d->patches.constEnd())
+    return *it;
+
   git_patch *patch = nullptr;
-  git_patch_from_diff(&patch, d->diff, d->map.at(index));
-  return Patch(patch);
+  git_patch_from_diff(&patch, d->diff, delta);
+
+  Patch result(patch);
+  result.mHandle = d->handle;
+  return result;
 }
 
 QString Diff::name(int index) const
 {
+  if (!d->diff) {
+    QMutexLocker locker(&d->lock);
+    return d->files.at(index).name;
+  }
+
   return d->delta(index)->new_file.path;
 }
 
 bool Diff::isBinary(int index) const
 {
+  if (!d->diff)
+    return false;
+
   return d->delta(index)->flags & GIT_DIFF_FLAG_BINARY;
 }
 
 git_delta_t Diff::status(int index) const
 {
+  if (!d->diff) {
+    QMutexLocker locker(&d->lock);
+    return d->files.at(index).status;
+  }
+
   return d->delta(index)->status;
 }
 
 Id Diff::id(int index, File file) const
 {
+  if (!d->diff)
+    return Id();
+
   const git_diff_delta *delta = d->delta(index);
   return (file == NewFile) ? delta->new_file.id : delta->old_file.id;
 }
 
+qint64 Diff::size(int index, File file, const Repository &repo) const
+{
+  if (!d->diff)
+    return -1;
+
+  const git_diff_delta *delta = d->delta(index);
+  const git_diff_file &diffFile =
+    (file == NewFile) ? delta->new_file : delta->old_file;
+  if (!(diffFile.flags & GIT_DIFF_FLAG_EXISTS))
+    return 0;
+
+  if (diffFile.size)
+    return diffFile.size;
+
+  if (!(diffFile.flags & GIT_DIFF_FLAG_VALID_ID) ||
+      git_oid_iszero(&diffFile.id))
+    return -1;
+
+  git_odb *odb = nullptr;
+  if (git_repository_odb(&odb, repo))
+    return -1;
+
+  size_t size = 0;
+  git_object_t type;
+  int error = git_odb_read_header(&size, &type, odb, &diffFile.id);
+  git_odb_free(odb);
+  return error ? -1 : size;
+}
+
 int Diff::indexOf(const QString &name) const
 {
   int count = this->count();
@@ -114,20 +441,89 @@ int Diff::indexOf(const QString &name) const
   return -1;
 }
 
+qint64 Diff::prefetchPatches(int count, qint64 maxSize)
+{
+  if (!d->diff)
+    return 0;
+
+  qint64 size = 0;
+  int deltas = qMin(count, this->count());
+  for (int i = 0; i < deltas && size < maxSize; ++i) {
+    int delta = d->map.at(i);
+    if (d->patches.contains(delta) || isBinary(i))
+      continue;
+
+    git_patch *patch = nullptr;
+    if (git_patch_from_diff(&patch, d->diff, delta) || !patch)
+      continue;
+
+    size += git_patch_size(patch, 1, 1, 1);
+
+    Patch result(patch);
+    result.mHandle = d->handle;
+    d->patches.insert(delta, result);
+  }
+
+  return size;
+}
+
 void Diff::merge(const Diff &diff)
 {
   git_diff_merge(d->diff, diff);
   d->resetMap();
 }
 
-void Diff::findSimilar()
+bool Diff::findSimilar(
+  const Repository &repo,
+  Callbacks *callbacks,
+  bool *partial)
 {
-  git_diff_find_similar(d->diff, nullptr);
+  // Zero limits and thresholds fall back to the git config.
+  int limit, threshold, timeout;
+  repo.renameOptions(limit, threshold, timeout);
+
+  Similarity similarity(repo, timeout, callbacks);
+  git_diff_similarity_metric metric = {
+    &Similarity::fileSignature,
+    &Similarity::bufferSignature,
+    &Similarity::freeSignature,
+    &Similarity::similarity,
+    &similarity
+  };
+
+  git_diff_find_options opts = GIT_DIFF_FIND_OPTIONS_INIT;
+  opts.rename_limit = limit;
+  opts.rename_threshold = threshold;
+  opts.copy_threshold = opts.rename_threshold;
+  opts.metric = &metric;
+
+  int error = git_diff_find_similar(d->diff, &opts);
   d->resetMap();
+  if (partial)
+    *partial = similarity.isExpired();
+
+  if (error)
+    return false;
+
+  // Signatures are complete even if others were skipped.
+  similarity.store();
+
+  int count = this->count();
+  for (int i = 0; i < count; ++i) {
+    git_delta_t status = this->status(i);
+    if (status == GIT_DELTA_RENAMED || status == GIT_DELTA_COPIED)
+      return true;
+  }
+
+  return false;
 }
 
 void Diff::sort(SortRole role, Qt::SortOrder order)
 {
+  // Pending files stay in the order that they were found.
+  if (!d->diff)
+    return;
+
   bool ascending = (order == Qt::AscendingOrder);
   std::sort(d->map.begin(), d->map.end(),
   [this, role, ascending](int lhs, int rhs) {
@@ -13,11 +13,15 @@
 #include "Id.h"
 #include "git2/diff.h"
 #include <QFlags>
+#include <QHash>
+#include <QMutex>
 #include <QSharedPointer>
+#include <QVector>
 
 namespace git {
 
 class Patch;
+class Repository;
 
 class Diff
 {
@@ -43,17 +47,34 @@ public:
       return false;
     }
 
+    // Called on the generating thread for each file as it's found.
+    virtual void delta(const QString &name, git_delta_t status) {}
+
     static int progress(
       const git_diff *diff,
       const char *oldPath,
       const char *newPath,
       void *payload);
+
+    static int notify(
+      const git_diff *diff,
+      const git_diff_delta *delta,
+      const char *pathspec,
+      void *payload);
   };
 
   Diff();
 
   bool isValid() const { return d; }
 
+  // A pending diff stands in for a diff that is still being generated.
+  // It only knows the names and statuses of the files found so far.
+  // count(), name(), status() and indexOf() are safe to call while
+  // files are appended from another thread. There are no patches.
+  static Diff pending();
+  bool isPending() const;
+  void append(const QString &name, git_delta_t status);
+
   bool isConflicted() const;
 
   int count() const;
@@ -63,13 +84,35 @@ public:
   git_delta_t status(int index) const;
   Id id(int index, File file) const;
 
+  // Get the size of a file without generating its patch. Sizes that
+  // aren't in the delta are read from the object header. Return -1
+  // if the size isn't known.
+  qint64 size(int index, File file, const Repository &repo) const;
+
   int indexOf(const QString &name) const;
 
+  // Generate patches for up to count files ahead of time so that
+  // patch() can return them without touching the object database.
+  // Stop after the total patch size exceeds maxSize. Return the
+  // total size in bytes of the generated patches.
+  qint64 prefetchPatches(int count, qint64 maxSize);
+
   // Merge the given diff into this diff.
   void merge(const Diff &diff);
 
-  // Detect renames, copies, etc. This is expensive.
-  void findSimilar();
+  // Detect renames, copies, etc. This is expensive. Unlike libgit2's
+  // default metric, similarity is the overlap of bottom-k sketches of
+  // distinct line hashes with all whitespace removed. That makes
+  // signatures small enough to cache by blob id in the repository.
+  // Scores are close to the default for typical edits, but whitespace-
+  // only changes count as identical. The rename limit, threshold and
+  // time budget come from the repository's app config. Files that
+  // haven't been hashed when the time runs out aren't paired, and
+  // partial is set. Return true if any renames or copies were found.
+  bool findSimilar(
+    const Repository &repo,
+    Callbacks *callbacks = nullptr,
+    bool *partial = nullptr);
 
   void sort(SortRole role, Qt::SortOrder order = Qt::AscendingOrder);
 
@@ -86,6 +129,22 @@ private:
 
     git_diff *diff;
     mutable QList<int> map;
+
+    // pooled handle that the diff was generated on
+    QSharedPointer<git_repository> handle;
+
+    // prefetched patches keyed by delta index
+    QHash<int,Patch> patches;
+
+    // files of a pending diff
+    struct PendingFile
+    {
+      QString name;
+      git_delta_t status;
+    };
+
+    mutable QMutex lock;
+    QVector<PendingFile> files;
   };
 
   Diff(git_diff *diff);
@@ -0,0 +1,389 @@
+//
+//          Copyright (c) 2016, Scientific Toolworks, Inc.
+//
+// This software is licensed under the MIT License. The LICENSE.md file
+// describes the conditions under which this software may be distributed.
+//
+// Author: Jason Haslam
+//
+
+#include "Ignore.h"
+#include "git2/buffer.h"
+#include "git2/config.h"
+#include "git2/repository.h"
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QStringList>
+
+namespace git {
+
+namespace {
+
+const QString kIgnoreFile = ".gitignore";
+const QString kExcludeFile = "info/exclude";
+const QLatin1String kGitDir(".git");
+
+// Minimum time between checks of an ignore file.
+const qint64 kCheckInterval = 1000;
+
+// Translate a glob to a regular expression. Wildcards don't
+// match '/' except for "**" between slashes, which matches
+// any number of directories.
+QString translate(const QString &pattern)
+{
+  QString result;
+  int length = pattern.length();
+  for (int i = 0; i < length; ++i) {
+    QChar ch = pattern.at(i);
+    switch (ch.unicode()) {
+      case '\\':
+        if (i + 1 < length)
+          ch = pattern.at(++i);
+        result += QRegularExpression::escape(ch);
+        break;
+
+      case '?':
+        result += "[^/]";
+        break;
+
+      case '*': {
+        int start = i;
+        while (i + 1 < length && pattern.at(i + 1) == '*')
+          ++i;
+
+        bool leading = (start == 0 || pattern.at(start - 1) == '/');
+        bool trailing = (i + 1 == length || pattern.at(i + 1) == '/');
+        if (i == start || !leading || !trailing) {
+          result += "[^/]*";
+        } else if (i + 1 == length) {
+          result += ".*";
+        } else {
+          result += "(?:.*/)?";
+          ++i; // Skip the slash.
+        }
+        break;
+      }
+
+      case '[': {
+        // Find the end of the bracket expression.
+        int end = i + 1;
+        if (end < length && (pattern.at(end) == '!' || pattern.at(end) == '^'))
+          ++end;
+        if (end < length && pattern.at(end) == ']')
+          ++end;
+        while (end < length && pattern.at(end) != ']') {
+          if (pattern.at(end) == '[' && end + 1 < length &&
+              pattern.at(end + 1) == ':') {
+            int close = pattern.indexOf(":]", end + 2);
+            end = (close >= 0) ? close + 2 : length;
+            continue;
+          }
+
+          if (pattern.at(end) == '\\')
+            ++end;
+          ++end;
+        }
+
+        if (end >= length) {
+          result += "\\[";
+          break;
+        }
+
+        bool negated = false;
+        int j = i + 1;
+        if (pattern.at(j) == '!' || pattern.at(j) == '^') {
+          negated = true;
+          ++j;
+        }
+
+        QString set;
+        for (; j < end; ++j) {
+          QChar c = pattern.at(j);
+          if (c == '[' && pattern.at(j + 1) == ':') {
+            int close = pattern.indexOf(":]", j + 2);
+            set += pattern.mid(j, close + 2 - j);
+            j = close + 1;
+            continue;
+          }
+
+          if (c == '\\' && j + 1 < end)
+            c = pattern.at(++j);
+          if (c == '\\' || c == '[' || c == ']' || c == '^')
+            set += '\\';
+          set += c;
+        }
+
+        // Bracket expressions never match '/'.
+        result += negated ? "[^/" + set + ']' : "(?!/)[" + set + ']';
+        i = end;
+        break;
+      }
+
+      default:
+        result += QRegularExpression::escape(ch);
+        break;
+    }
+  }
+
+  return result;
+}
+
+} // anon. namespace
+
+Ignore::Ignore(git_repository *repo)
+  : mRepo(repo)
+{}
+
+bool Ignore::isIgnored(const QString &path)
+{
+  QMutexLocker locker(&mLock);
+  if (!mInitialized)
+    init();
+
+  if (mWorkdir.isEmpty() || path.isEmpty())
+    return false;
+
+  // The type of the path is checked on demand.
+  bool slash = path.endsWith('/');
+  QString name = slash ? path.left(path.length() - 1) : path;
+  int dir = slash ? 1 : -1;
+
+  Qt::CaseSensitivity cs =
+    mIgnoreCase ? Qt::CaseInsensitive : Qt::CaseSensitive;
+
+  // Match the path and then each parent directory.
+  int end = name.length();
+  while (end > 0) {
+    QString level = name.left(end);
+    int slashPos = level.lastIndexOf('/');
+    if (level.midRef(slashPos + 1).compare(kGitDir, cs) == 0)
+      return true;
+
+    // Start with the ignore file in the deepest directory.
+    int pos = slashPos;
+    forever {
+      QString prefix = level.left(pos + 1);
+      Match result = match(rules(prefix), level, prefix.length(), dir);
+      if (result != None)
+        return (result == Ignored);
+
+      if (pos <= 0)
+        break;
+
+      pos = level.lastIndexOf('/', pos - 1);
+    }
+
+    load(mExclude);
+    Match result = match(mExclude, level, 0, dir);
+    if (result == None) {
+      load(mGlobal);
+      result = match(mGlobal, level, 0, dir);
+    }
+
+    if (result != None)
+      return (result == Ignored);
+
+    end = slashPos;
+    dir = 1;
+  }
+
+  return false;
+}
+
+void Ignore::invalidate()
+{
+  QMutexLocker locker(&mLock);
+  QMutableHashIterator<QString,Rules> it(mRules);
+  while (it.hasNext())
+    it.next().value().checked = -1;
+
+  mExclude.checked = -1;
+  mGlobal.checked = -1;
+}
+
+QStringList Ignore::globalFiles()
+{
+  QMutexLocker locker(&mLock);
+  if (!mInitialized)
+    init();
+
+  return {mExclude.file, mGlobal.file};
+}
+
+void Ignore::init()
+{
+  mInitialized = true;
+  mTimer.start();
+
+  if (const char *workdir = git_repository_workdir(mRepo))
+    mWorkdir = QString::fromUtf8(workdir);
+
+  QString path = QString::fromUtf8(git_repository_path(mRepo));
+  mExclude.file = path + kExcludeFile;
+
+  git_config *config = nullptr;
+  if (!git_repository_config_snapshot(&config, mRepo)) {
+    int ignoreCase = 0;
+    if (!git_config_get_bool(&ignoreCase, config, "core.ignorecase"))
+      mIgnoreCase = ignoreCase;
+
+    git_buf buf = GIT_BUF_INIT_CONST(nullptr, 0);
+    if (!git_config_get_path(&buf, config, "core.excludesfile"))
+      mGlobal.file = QString::fromUtf8(buf.ptr, buf.size);
+    git_buf_dispose(&buf);
+
+    git_config_free(config);
+  }
+
+  // Fall back to the XDG ignore file like libgit2.
+  if (mGlobal.file.isEmpty()) {
+    QString xdg = QString::fromLocal8Bit(qgetenv("XDG_CONFIG_HOME"));
+    if (xdg.isEmpty())
+      xdg = QDir::home().filePath(".config");
+    mGlobal.file = QDir(xdg).filePath("git/ignore");
+  }
+}
+
+void Ignore::load(Rules &rules)
+{
+  qint64 now = mTimer.elapsed();
+  if (rules.checked >= 0 && now - rules.checked < kCheckInterval)
+    return;
+
+  rules.checked = now;
+
+  QFileInfo info(rules.file);
+  bool exists = info.exists();
+  qint64 modified = exists ? info.lastModified().toMSecsSinceEpoch() : -1;
+  qint64 size = exists ? info.size() : -1;
+  if (rules.loaded && rules.modified == modified && rules.size == size)
+    return;
+
+  rules.loaded = true;
+  rules.modified = modified;
+  rules.size = size;
+  rules.rules.clear();
+  rules.fileRules.clear();
+
+  QFile file(rules.file);
+  if (!exists || !file.open(QFile::ReadOnly))
+    return;
+
+  // Later rules take precedence, so add them first.
+  QStringList all;
+  QStringList files;
+  QList<QByteArray> lines = file.readAll().split('\n');
+  for (int i = lines.size() - 1; i >= 0; --i) {
+    QString line = QString::fromUtf8(lines.at(i));
+    if (line.endsWith('\r'))
+      line.chop(1);
+
+    // Trim trailing whitespace that isn't escaped.
+    int end = line.length();
+    while (end > 0 && line.at(end - 1).isSpace() &&
+           (end < 2 || line.at(end - 2) != '\\'))
+      --end;
+    line.truncate(end);
+
+    if (line.isEmpty() || line.startsWith('#'))
+      continue;
+
+    Rule rule = {false, false};
+    if (line.startsWith('!')) {
+      rule.negated = true;
+      line.remove(0, 1);
+    }
+
+    if (line.endsWith('/')) {
+      rule.directory = true;
+      line.chop(1);
+    }
+
+    // Patterns without a slash match the name at any level.
+    bool anchored = line.contains('/');
+    if (line.startsWith('/'))
+      line.remove(0, 1);
+
+    if (line.isEmpty())
+      continue;
+
+    QString pattern = translate(line);
+    if (!anchored)
+      pattern.prepend("(?:.*/)?");
+
+    pattern = '(' + pattern + ')';
+    if (!QRegularExpression(pattern).isValid())
+      continue;
+
+    rules.rules.append(rule);
+    all.append(pattern);
+    if (!rule.directory) {
+      rules.fileRules.append(rules.rules.size() - 1);
+      files.append(pattern);
+    }
+  }
+
+  // Alternatives are tried in order, so the first
+  // group that matches is the highest precedence rule.
+  QRegularExpression::PatternOptions options =
+    mIgnoreCase ? QRegularExpression::CaseInsensitiveOption :
+                  QRegularExpression::NoPatternOption;
+
+  rules.all = QRegularExpression(
+    "\\A(?:" + all.join('|') + ")\\z", options);
+  rules.all.optimize();
+
+  rules.files = QRegularExpression(
+    "\\A(?:" + files.join('|') + ")\\z", options);
+  rules.files.optimize();
+}
+
+Ignore::Rules &Ignore::rules(const QString &dir)
+{
+  Rules &rules = mRules[dir];
+  if (rules.file.isEmpty())
+    rules.file = mWorkdir + dir + kIgnoreFile;
+
+  load(rules);
+  return rules;
+}
+
+Ignore::Match Ignore::match(
+  Rules &rules,
+  const QString &path,
+  int pos,
+  int &dir)
+{
+  if (rules.rules.isEmpty())
+    return None;
+
+  QStringRef relative = path.midRef(pos);
+  QRegularExpressionMatch match = rules.all.match(relative);
+  if (!match.hasMatch())
+    return None;
+
+  Rule rule = rules.rules.at(match.lastCapturedIndex() - 1);
+  if (rule.directory) {
+    if (dir < 0)
+      dir = QFileInfo(mWorkdir + path).isDir();
+
+    // Fall back to the rules that match files.
+    if (!dir) {
+      if (rules.fileRules.isEmpty())
+        return None;
+
+      match = rules.files.match(relative);
+      if (!match.hasMatch())
+        return None;
+
+      int index = rules.fileRules.at(match.lastCapturedIndex() - 1);
+      rule = rules.rules.at(index);
+    }
+  }
+
+  return rule.negated ? Included : Ignored;
+}
+
+} // namespace git
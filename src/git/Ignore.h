@@ -0,0 +1,100 @@
+//
+//          Copyright (c) 2016, Scientific Toolworks, Inc.
+//
+// This software is licensed under the MIT License. The LICENSE.md file
+// describes the conditions under which this software may be distributed.
+//
+// Author: Jason Haslam
+//
+
+#ifndef IGNORE_H
+#define IGNORE_H
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QMutex>
+#include <QRegularExpression>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+struct git_repository;
+
+namespace git {
+
+// Compiled ignore rules of a repository. Each ignore file is parsed once
+// and all of its patterns are combined into a single regular expression.
+// Files are checked for changes at most once per interval. Precedence
+// follows libgit2: the path and then each of its parents is matched
+// against the deepest ignore file first. This is safe to call from any
+// thread.
+class Ignore
+{
+public:
+  Ignore(git_repository *repo);
+
+  // The path is relative to the workdir. Directories may be
+  // passed with a trailing '/' to avoid checking the filesystem.
+  bool isIgnored(const QString &path);
+
+  // Check ignore files for changes on the next lookup.
+  void invalidate();
+
+  // Get the ignore files that apply to every path: the
+  // repository's info/exclude file and the global file.
+  QStringList globalFiles();
+
+private:
+  enum Match
+  {
+    None,
+    Ignored,
+    Included
+  };
+
+  struct Rule
+  {
+    bool negated;
+    bool directory;
+  };
+
+  // The rules of one ignore file in order of precedence. Capture
+  // group n of the combined expression corresponds to rule n - 1.
+  struct Rules
+  {
+    QString file;
+    bool loaded = false;
+    qint64 modified = -1;
+    qint64 size = -1;
+    qint64 checked = -1;
+
+    QVector<Rule> rules;
+    QRegularExpression all;
+
+    // Rules that also match files.
+    QVector<int> fileRules;
+    QRegularExpression files;
+  };
+
+  void init();
+  void load(Rules &rules);
+  Rules &rules(const QString &dir);
+  Match match(Rules &rules, const QString &path, int pos, int &dir);
+
+  git_repository *mRepo;
+  QString mWorkdir;
+
+  QMutex mLock;
+  QElapsedTimer mTimer;
+  bool mInitialized = false;
+  bool mIgnoreCase = false;
+
+  // Ignore files keyed by directory with a trailing '/'.
+  QHash<QString,Rules> mRules;
+  Rules mExclude;
+  Rules mGlobal;
+};
+
+} // namespace git
+
+#endif
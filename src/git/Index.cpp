@@ -9,25 +9,100 @@
 
 #include "Index.h"
 #include "Commit.h"
+#include "Diff.h"
 #include "Reference.h"
 #include "Repository.h"
 #include "Signature.h"
 #include "Submodule.h"
 #include "Tree.h"
 #include "git2/commit.h"
-#include "git2/ignore.h"
+#include "git2/diff.h"
 #include "git2/refs.h"
 #include "git2/repository.h"
 #include "git2/status.h"
 #include "git2/tree.h"
+#include "git2/sys/index.h"
+#include "git2/sys/repository.h"
+#include <QAtomicInt>
 #include <QDateTime>
 #include <QDir>
 #include <QFileInfo>
+#include <QFutureWatcher>
+#include <QtConcurrent>
+#include <functional>
 
 namespace git {
 
 namespace {
 
+// Hash and write blobs concurrently when adding at least this many files.
+const int kConcurrentAddCount = 16;
+
+// Number of files added by each worker.
+const int kAddChunkSize = 32;
+
+struct AddedEntry
+{
+  bool added;
+  git_index_entry entry;
+  QByteArray path;
+};
+
+// Resolve a conflict like git_index_add_bypath() does. The conflicting
+// sides are kept in the resolve undo data and removed from the index.
+void resolveConflict(git_index *index, const char *path)
+{
+  const git_index_entry *ancestor, *ours, *theirs;
+  if (git_index_conflict_get(&ancestor, &ours, &theirs, index, path))
+    return;
+
+  git_index_reuc_add(index, path,
+    ancestor ? ancestor->mode : 0, ancestor ? &ancestor->id : nullptr,
+    ours ? ours->mode : 0, ours ? &ours->id : nullptr,
+    theirs ? theirs->mode : 0, theirs ? &theirs->id : nullptr);
+  git_index_conflict_remove(index, path);
+}
+
+// Reading, filtering and compressing files dominates. Add them on a
+// separate handle with its own in-memory index so that libgit2 fills
+// in the stat data of each entry without touching the shared index.
+QList<AddedEntry> addEntries(
+  const QString &workdir,
+  const QStringList &files,
+  const QAtomicInt &canceled)
+{
+  QList<AddedEntry> results;
+  foreach (const QString &file, files) {
+    AddedEntry result;
+    result.added = false;
+    result.path = file.toUtf8();
+    results.append(result);
+  }
+
+  git_repository *repo = nullptr;
+  if (git_repository_open(&repo, workdir.toUtf8()))
+    return results;
+
+  git_index *index = nullptr;
+  if (!git_index_new(&index)) {
+    git_repository_set_index(repo, index);
+    for (int i = 0; i < results.size() && !canceled.load(); ++i) {
+      AddedEntry &result = results[i];
+      if (git_index_add_bypath(index, result.path))
+        continue;
+
+      result.added = true;
+      result.entry = *git_index_get_bypath(index, result.path, 0);
+      result.entry.path = nullptr;
+    }
+
+    git_index_free(index);
+  }
+
+  git_repository_free(repo);
+  return results;
+}
+
 void countDirectoryEntries(const QString &file, int &count)
 {
   QDir dir(file);
@@ -144,13 +219,158 @@ Index::StagedState Index::isStaged(const QString &path) const
   return d->stagedCache.insert(path, PartiallyStaged).value();
 }
 
+void Index::prefetchStagedStates(const Diff &diff) const
+{
+  if (!diff.isValid() || diff.isPending())
+    return;
+
+  // Submodules and untracked directories take the slow path.
+  Repository repo(git_index_owner(d->index));
+  QDir dir = repo.workdir();
+  QStringList paths;
+  int count = diff.count();
+  for (int i = 0; i < count; ++i) {
+    QString path = diff.name(i);
+    if (d->stagedCache.contains(path))
+      continue;
+
+    QFileInfo info(dir.filePath(path));
+    if (isSubmodule(path) || (!info.isSymLink() && info.isDir())) {
+      isStaged(path);
+      continue;
+    }
+
+    paths.append(path);
+  }
+
+  if (paths.isEmpty())
+    return;
+
+  // Compare the workdir to this index. Files that match
+  // by stat data don't show up in the diff at all.
+  QList<QByteArray> storage;
+  foreach (const QString &path, paths)
+    storage.append(path.toUtf8());
+
+  QVector<char *> strings;
+  for (int i = 0; i < storage.size(); ++i)
+    strings.append(storage[i].data());
+
+  git_diff_options opts = GIT_DIFF_OPTIONS_INIT;
+  opts.flags |= GIT_DIFF_DISABLE_PATHSPEC_MATCH;
+  opts.pathspec.count = strings.size();
+  opts.pathspec.strings = strings.data();
+
+  git_diff *workdir = nullptr;
+  if (git_diff_index_to_workdir(&workdir, repo, d->index, &opts))
+    return;
+
+  // Ids of files that were compared by content are already known.
+  // The rest have to be hashed.
+  QHash<QString,const git_diff_delta *> deltas;
+  QStringList unknown;
+  int deltaCount = git_diff_num_deltas(workdir);
+  for (int i = 0; i < deltaCount; ++i) {
+    const git_diff_delta *delta = git_diff_get_delta(workdir, i);
+    QString path = delta->new_file.path;
+    deltas.insert(path, delta);
+    if (delta->status == GIT_DELTA_MODIFIED &&
+        !(delta->new_file.flags & GIT_DIFF_FLAG_VALID_ID))
+      unknown.append(path);
+  }
+
+  // Hash on separate handles. Filters aren't safe to run concurrently
+  // on the same repository.
+  std::function<Id(const QString &)> hash = [&repo](const QString &path) {
+    git_repository *handle = repo.acquireHandle();
+    if (!handle)
+      return Id::invalidId();
+
+    git_oid id;
+    int error = git_repository_hashfile(
+      &id, handle, path.toUtf8(), GIT_OBJECT_BLOB, nullptr);
+    repo.releaseHandle(handle);
+    if (error)
+      return (error == GIT_EUSER) ? Id::invalidId() : Id();
+
+    return Id(id);
+  };
+
+  QList<Id> ids = QtConcurrent::blockingMapped<QList<Id>>(unknown, hash);
+  QHash<QString,Id> hashes;
+  for (int i = 0; i < unknown.size(); ++i)
+    hashes.insert(unknown.at(i), ids.at(i));
+
+  // Look up HEAD once for all paths.
+  Tree tree;
+  if (Reference head = repo.head()) {
+    if (Commit commit = head.target())
+      tree = commit.tree();
+  }
+
+  foreach (const QString &path, paths) {
+    Id head;
+    uint32_t headMode = 0, indexMode = 0;
+    git_tree_entry *entry = nullptr;
+    if (tree.isValid() &&
+        !git_tree_entry_bypath(&entry, tree, path.toUtf8())) {
+      head = git_tree_entry_id(entry);
+      headMode = git_tree_entry_filemode_raw(entry);
+      git_tree_entry_free(entry);
+    }
+
+    Id index = indexId(path, &indexMode);
+
+    // Files that aren't in the diff match the index.
+    bool match = true;
+    if (const git_diff_delta *delta = deltas.value(path)) {
+      match = false;
+      if (hashes.contains(path)) {
+        Id workdir = hashes.value(path);
+        if (!workdir.isValid()) {
+          d->stagedCache.insert(path, Unstaged);
+          continue;
+        }
+
+        match = (workdir == index && delta->new_file.mode == indexMode);
+      }
+    } else if (index.isNull()) {
+      // Untracked files aren't compared.
+      match = !dir.exists(path);
+    }
+
+    StagedState state = PartiallyStaged;
+    if (match) {
+      state = Staged;
+    } else if (head == index && headMode == indexMode) {
+      state = Unstaged;
+    } else if (conflict(path).isValid()) {
+      state = Conflicted;
+    }
+
+    d->stagedCache.insert(path, state);
+  }
+
+  git_diff_free(workdir);
+}
+
 void Index::setStaged(const QStringList &files, bool staged, bool yieldFocus)
 {
+  // Wait until many files added in the background are done.
+  Repository repo(git_index_owner(d->index));
+  if (repo.d->staging) {
+    Index index = *this;
+    repo.d->stagingQueue.append([index, files, staged, yieldFocus]() mutable {
+      index.setStaged(files, staged, yieldFocus);
+    });
+    return;
+  }
+
   bool promptDir = true;
   bool promptSize = true;
-  bool dirAdded = false;
   QStringList changedFiles;
-  Repository repo(git_index_owner(d->index));
+  QStringList addedFiles;
+  QStringList addedDirs;
   RepositoryNotifier *notifier = repo.notifier();
   foreach (const QString &file, files) {
     QByteArray path = file.toUtf8();
@@ -219,23 +439,17 @@ void Index::setStaged(const QStringList &files, bool staged, bool yieldFocus)
         QDir dir = repo.workdir();
         QFileInfo info(dir.filePath(file));
         if (!info.isSymLink() && info.isDir()) {
-          // FIXME: This is a workaround.
-          QString current = QDir::currentPath();
-          QDir::setCurrent(dir.path());
-
           int count = 0;
           bool allow = true;
-          countDirectoryEntries(file, count);
+          countDirectoryEntries(dir.filePath(file), count);
           emit notifier->directoryAboutToBeStaged(
             file, count, allow, promptDir);
-          bool added = (allow && addDirectory(file));
-
-          QDir::setCurrent(current);
-
-          if (!added)
+          if (!allow)
             continue;
 
-          dirAdded = true;
+          // Add the files of the directory with the rest.
+          listDirectory(file, addedFiles);
+          addedDirs.append(file);
 
         } else {
           int size = QFileInfo(repo.workdir(), file).size();
@@ -244,15 +458,12 @@ void Index::setStaged(const QStringList &files, bool staged, bool yieldFocus)
             emit notifier->largeFileAboutToBeStaged(
               file, size, allow, promptSize);
 
-          if (!allow)
-            continue;
-
-          if (git_index_add_bypath(d->index, path)) {
-            emit notifier->indexStageError(file);
-            continue;
-          }
+          if (allow)
+            addedFiles.append(file);
         }
 
+        continue;
+
       } else {
         // Remove from index.
         if (git_index_remove_bypath(d->index, path)) {
@@ -287,15 +498,8 @@ void Index::setStaged(const QStringList &files, bool staged, bool yieldFocus)
     changedFiles.append(file);
   }
 
-  if (!changedFiles.isEmpty()) {
-    git_index_write(d->index);
-    foreach (const QString &changedFile, changedFiles)
-      d->stagedCache.remove(changedFile);
-    emit notifier->indexChanged(changedFiles, yieldFocus);
-  }
-
-  if (dirAdded)
-    emit notifier->directoryStaged();
+  // Add workdir files in one batch.
+  addFiles(addedFiles, changedFiles, addedDirs, yieldFocus);
 }
 
 void Index::add(const QString &path, const QByteArray &buffer)
@@ -318,6 +522,34 @@ void Index::add(const QString &path, const QByteArray &buffer)
   emit repo.notifier()->indexChanged({path});
 }
 
+void Index::add(const QString &path, const Id &id, size_t size)
+{
+  const git_index_entry *entry = this->entry(path);
+  if (!entry) {
+    git_index_add_bypath(d->index, path.toUtf8());
+    entry = this->entry(path);
+  }
+
+  if (!entry)
+    return;
+
+  // Keep the stat data like git_index_add_from_buffer() does.
+  git_index_entry copy = *entry;
+  QByteArray name = entry->path;
+  copy.path = name.constData();
+  copy.id = id.d;
+  copy.file_size = size;
+  if (git_index_add(d->index, &copy))
+    return;
+
+  resolveConflict(d->index, copy.path);
+
+  git_index_write(d->index);
+  d->stagedCache.remove(path);
+  git::Repository repo(git_index_owner(d->index));
+  emit repo.notifier()->indexChanged({path});
+}
+
 Tree Index::writeTree() const
 {
   // Write the index tree.
@@ -360,29 +592,149 @@ bool Index::isSubmodule(const QString &path) const
   return d->submodules.contains(path);
 }
 
-bool Index::addDirectory(const QString &file) const
+void Index::listDirectory(const QString &path, QStringList &files) const
 {
-  QDir dir(file);
-  git_repository *repo = git_index_owner(d->index);
+  Repository repo(git_index_owner(d->index));
+  QDir dir(repo.workdir().filePath(path));
+  QString prefix = path.endsWith('/') ? path : path + '/';
   auto filters = QDir::Dirs | QDir::Files | QDir::NoDotAndDotDot;
   foreach (const QString &entry, dir.entryList(filters)) {
-    QString file = dir.filePath(entry);
-    if (QFileInfo(file).isDir()) {
-      if (!addDirectory(file))
-        return false;
+    QString file = prefix + entry;
+    QFileInfo info(dir.filePath(entry));
+    if (!info.isSymLink() && info.isDir()) {
+      if (!repo.isIgnored(file + '/'))
+        listDirectory(file, files);
       continue;
     }
 
-    int ignored = 0;
-    QByteArray path = file.toUtf8();
-    if (git_ignore_path_is_ignored(&ignored, repo, path) || ignored)
-      continue;
+    if (!repo.isIgnored(file))
+      files.append(file);
+  }
+}
+
+void Index::addFiles(
+  const QStringList &files,
+  const QStringList &changedFiles,
+  const QStringList &addedDirs,
+  bool yieldFocus)
+{
+  Repository repo(git_index_owner(d->index));
+  RepositoryNotifier *notifier = repo.notifier();
+  if (files.size() < kConcurrentAddCount) {
+    QStringList added;
+    foreach (const QString &file, files) {
+      if (git_index_add_bypath(d->index, file.toUtf8())) {
+        emit notifier->indexStageError(file);
+        continue;
+      }
+
+      added.append(file);
+    }
+
+    finishStaging(changedFiles, added, addedDirs, yieldFocus);
+    return;
+  }
+
+  QList<QStringList> chunks;
+  for (int i = 0; i < files.size(); i += kAddChunkSize)
+    chunks.append(files.mid(i, kAddChunkSize));
+
+  QString path = repo.workdir().path();
+  QSharedPointer<QAtomicInt> canceled(new QAtomicInt(0));
+  std::function<QList<AddedEntry>(const QStringList &)> add =
+  [path, canceled](const QStringList &chunk) {
+    return addEntries(path, chunk, *canceled);
+  };
+
+  // Finish from the watcher so that the event loop keeps running.
+  int total = files.size();
+  auto watcher = new QFutureWatcher<QList<AddedEntry>>(notifier);
+  QObject::connect(watcher, &QFutureWatcherBase::progressValueChanged,
+  [notifier, watcher, canceled, total](int value) {
+    if (canceled->load())
+      return;
+
+    bool cancel = false;
+    int count = qMin(value * kAddChunkSize, total);
+    emit notifier->indexStageProgress(count, total, cancel);
+    if (cancel) {
+      canceled->store(1);
+      watcher->cancel();
+    }
+  });
+
+  Index index = *this;
+  QObject::connect(watcher, &QFutureWatcherBase::finished, watcher,
+  [index, repo, watcher, canceled, total,
+   changedFiles, addedDirs, yieldFocus]() mutable {
+    repo.d->staging = false;
+    watcher->deleteLater();
+
+    bool cancel = false;
+    RepositoryNotifier *notifier = repo.notifier();
+    emit notifier->indexStageProgress(total, total, cancel);
+
+    // Build the index entries in one batch.
+    QStringList added;
+    if (!canceled->load() && !watcher->isCanceled()) {
+      foreach (QList<AddedEntry> results, watcher->future().results()) {
+        for (int i = 0; i < results.size(); ++i) {
+          AddedEntry &result = results[i];
+          QString file = QString::fromUtf8(result.path);
+          result.entry.path = result.path.constData();
+          if (!result.added || git_index_add(index.d->index, &result.entry)) {
+            emit notifier->indexStageError(file);
+            continue;
+          }
+
+          resolveConflict(index.d->index, result.entry.path);
+          added.append(file);
+        }
+      }
+    }
+
+    index.finishStaging(changedFiles, added, addedDirs, yieldFocus);
+    emit notifier->indexStagingChanged(false);
+
+    // Run requests that were made in the meantime. They
+    // queue again if one of them adds many files.
+    QList<std::function<void()>> queue = repo.d->stagingQueue;
+    repo.d->stagingQueue.clear();
+    foreach (const std::function<void()> &request, queue)
+      request();
+  });
+
+  repo.d->staging = true;
+  emit notifier->indexStagingChanged(true);
+  watcher->setFuture(QtConcurrent::mapped(chunks, add));
+}
 
-    if (git_index_add_bypath(d->index, path))
-      return false;
+void Index::finishStaging(
+  QStringList changedFiles,
+  const QStringList &added,
+  const QStringList &addedDirs,
+  bool yieldFocus)
+{
+  bool dirAdded = false;
+  if (!added.isEmpty()) {
+    changedFiles.append(added);
+    if (!addedDirs.isEmpty()) {
+      changedFiles.append(addedDirs);
+      dirAdded = true;
+    }
   }
 
-  return true;
+  Repository repo(git_index_owner(d->index));
+  RepositoryNotifier *notifier = repo.notifier();
+  if (!changedFiles.isEmpty()) {
+    git_index_write(d->index);
+    foreach (const QString &changedFile, changedFiles)
+      d->stagedCache.remove(changedFile);
+    emit notifier->indexChanged(changedFiles, yieldFocus);
+  }
+
+  if (dirAdded)
+    emit notifier->directoryStaged();
 }
 
 Id Index::headId(const QString &path, uint32_t *mode) const
@@ -18,6 +18,7 @@
 
 namespace git {
 
+class Diff;
 class Tree;
 
 class Index
@@ -54,10 +55,23 @@ public:
 
   bool isTracked(const QString &path) const;
   StagedState isStaged(const QString &path) const;
+
+  // Compute the staged state of every file in the diff ahead of time so
+  // that isStaged() can return it from the cache. The workdir is compared
+  // to the index by stat data. Only files that differ are hashed, which
+  // is done concurrently.
+  void prefetchStagedStates(const Diff &diff) const;
+
+  // Adding many files finishes in the background. The index is written
+  // and indexChanged() is emitted when it's done. Requests made in the
+  // meantime are ignored.
   void setStaged(const QStringList &paths, bool staged, bool yieldFocus = true);
 
   void add(const QString &path, const QByteArray &buffer);
 
+  // Add a blob that's already in the object database.
+  void add(const QString &path, const Id &id, size_t size);
+
   Tree writeTree() const;
 
   bool hasConflicts() const;
@@ -84,7 +98,24 @@ private:
   const git_index_entry *entry(const QString &path, int stage = 0) const;
 
   bool isSubmodule(const QString &path) const;
-  bool addDirectory(const QString &path) const;
+  // Collect files below the directory that aren't ignored.
+  void listDirectory(const QString &path, QStringList &files) const;
+
+  // Add workdir files to the index and finish staging. Many files are
+  // added concurrently in the background. Progress is reported through
+  // the notifier.
+  void addFiles(
+    const QStringList &files,
+    const QStringList &changedFiles,
+    const QStringList &addedDirs,
+    bool yieldFocus);
+
+  // Write the index and notify about the changed files.
+  void finishStaging(
+    QStringList changedFiles,
+    const QStringList &added,
+    const QStringList &addedDirs,
+    bool yieldFocus);
 
   Id headId(const QString &path, uint32_t *mode = nullptr) const;
   Id indexId(const QString &path, uint32_t *mode = nullptr) const;
@@ -12,9 +12,11 @@
 #include "Id.h"
 #include "Repository.h"
 #include "git2/filter.h"
+#include "git2/odb.h"
 #include <QDataStream>
 #include <QFile>
 #include <QMap>
+#include <cstring>
 
 namespace git {
 
@@ -247,6 +249,55 @@ QByteArray Patch::lineContent(int index, int ln) const
   return !result ? QByteArray(line->content, line->content_len) : QByteArray();
 }
 
+Patch::Hunk Patch::hunk(int index) const
+{
+  Hunk hunk;
+  if (isConflicted()) {
+    const ConflictHunk &conflict = mConflicts.at(index);
+    int count = conflict.lines.size();
+    hunk.lines.reserve(count);
+    for (int i = 0; i < count; ++i) {
+      const QByteArray &text = conflict.lines.at(i);
+      int line = conflict.line + i;
+      hunk.lines.append(
+        {lineOrigin(index, i), line, line, hunk.content.size(), text.size()});
+      hunk.content.append(text);
+    }
+
+    return hunk;
+  }
+
+  size_t count = 0;
+  if (git_patch_get_hunk(nullptr, &count, d.data(), index))
+    return hunk;
+
+  // Size the buffer up front.
+  int size = 0;
+  QVector<const git_diff_line *> lines;
+  lines.reserve(count);
+  for (size_t i = 0; i < count; ++i) {
+    const git_diff_line *line = nullptr;
+    if (git_patch_get_line_in_hunk(&line, d.data(), index, i))
+      return Hunk();
+
+    lines.append(line);
+    size += line->content_len;
+  }
+
+  hunk.content.reserve(size);
+  hunk.lines.reserve(count);
+  foreach (const git_diff_line *line, lines) {
+    hunk.lines.append({
+      line->origin, line->old_lineno, line->new_lineno,
+      hunk.content.size(), static_cast<int>(line->content_len)
+    });
+
+    hunk.content.append(line->content, line->content_len);
+  }
+
+  return hunk;
+}
+
 Patch::ConflictResolution Patch::conflictResolution(int index)
 {
   Repository repo(git_patch_owner(d.data()));
@@ -294,30 +345,30 @@ QByteArray Patch::apply(
     if (!hunks.at(i))
       continue;
 
-    size_t lines = 0;
-    const git_diff_hunk *hunk = nullptr;
-    if (git_patch_get_hunk(&hunk, &lines, d.data(), i))
+    const git_diff_hunk *header = nullptr;
+    if (git_patch_get_hunk(&header, nullptr, d.data(), i))
       continue;
 
     // FIXME: Incorrectly prepends when there are zero lines
     // of context and there's an addition after the first line.
-    int index = hunk->old_start ? hunk->old_start - 1 : 0;
+    int index = header->old_start ? header->old_start - 1 : 0;
     bool prepend = (index == 0);
-    for (int j = 0; j < lines; ++j) {
-      const git_diff_line *line = nullptr;
-      if (git_patch_get_line_in_hunk(&line, d.data(), i, j))
-        continue;
 
-      if (line->old_lineno > 0)
-        index = line->old_lineno - 1;
+    Hunk hunk = this->hunk(i);
+    int lines = hunk.lines.size();
+    for (int j = 0; j < lines; ++j) {
+      const Line &line = hunk.lines.at(j);
+      if (line.oldLine > 0)
+        index = line.oldLine - 1;
 
-      switch (line->origin) {
+      switch (line.origin) {
         case GIT_DIFF_LINE_CONTEXT:
           prepend = false;
           break;
 
         case GIT_DIFF_LINE_ADDITION: {
-          QByteArray text(line->content, line->content_len);
+          // Copy out of the shared hunk buffer.
+          QByteArray text(hunk.content.constData() + line.offset, line.length);
           image[index].insert(prepend ? 0 : image.at(index).size(), text);
           break;
         }
@@ -354,6 +405,156 @@ QByteArray Patch::apply(
   return filtered;
 }
 
+Id Patch::applyToOdb(const QBitArray &hunks, size_t *size) const
+{
+  git_repository *repo = git_patch_owner(d.data());
+  if (!repo)
+    return Id();
+
+  // Find line starts in the old blob.
+  Blob blob = this->blob(Diff::OldFile);
+  QByteArray source = blob.isValid() ? blob.rawContent() : QByteArray();
+  const char *data = source.constData();
+  int length = source.length();
+
+  QVector<int> starts = {0};
+  const char *end = data + length;
+  const char *newline = static_cast<const char *>(memchr(data, '\n', length));
+  while (newline) {
+    starts.append(newline - data + 1);
+    newline = static_cast<const char *>(
+      memchr(newline + 1, '\n', end - newline - 1));
+  }
+
+  // Collect changes by old line. Added lines are
+  // inserted before or after the old line.
+  struct Edit
+  {
+    QList<QByteArray> before;
+    bool deleted = false;
+    QList<QByteArray> after;
+  };
+
+  QMap<int,Edit> edits;
+  for (int i = 0; i < hunks.size(); ++i) {
+    if (!hunks.at(i))
+      continue;
+
+    const git_diff_hunk *header = nullptr;
+    if (git_patch_get_hunk(&header, nullptr, d.data(), i))
+      continue;
+
+    int index = header->old_start ? header->old_start - 1 : 0;
+    bool prepend = (index == 0);
+
+    Hunk hunk = this->hunk(i);
+    int lines = hunk.lines.size();
+    for (int j = 0; j < lines; ++j) {
+      const Line &line = hunk.lines.at(j);
+      if (line.oldLine > 0)
+        index = line.oldLine - 1;
+
+      if (index >= starts.size())
+        continue;
+
+      switch (line.origin) {
+        case GIT_DIFF_LINE_CONTEXT:
+          prepend = false;
+          break;
+
+        case GIT_DIFF_LINE_ADDITION: {
+          QByteArray text(hunk.content.constData() + line.offset, line.length);
+          Edit &edit = edits[index];
+          (prepend ? edit.before : edit.after).append(text);
+          break;
+        }
+
+        case GIT_DIFF_LINE_DELETION: {
+          Edit &edit = edits[index];
+          edit.before.clear();
+          edit.deleted = true;
+          edit.after.clear();
+          prepend = false;
+          break;
+        }
+
+        default:
+          break;
+      }
+    }
+  }
+
+  // The stream needs to know the size up front.
+  auto lineEnd = [&starts, length](int index) {
+    return (index + 1 < starts.size()) ? starts.at(index + 1) : length;
+  };
+
+  size_t total = length;
+  QMapIterator<int,Edit> it(edits);
+  while (it.hasNext()) {
+    it.next();
+    const Edit &edit = it.value();
+    if (edit.deleted)
+      total -= lineEnd(it.key()) - starts.at(it.key());
+    foreach (const QByteArray &text, edit.before)
+      total += text.length();
+    foreach (const QByteArray &text, edit.after)
+      total += text.length();
+  }
+
+  git_odb *odb = nullptr;
+  if (git_repository_odb(&odb, repo))
+    return Id();
+
+  git_odb_stream *stream = nullptr;
+  if (git_odb_open_wstream(&stream, odb, total, GIT_OBJECT_BLOB)) {
+    git_odb_free(odb);
+    return Id();
+  }
+
+  // Copy unchanged ranges of the old blob between edits.
+  int error = 0;
+  int pos = 0;
+  auto write = [stream, &error](const char *ptr, size_t len) {
+    if (!error && len)
+      error = git_odb_stream_write(stream, ptr, len);
+  };
+
+  it.toFront();
+  while (it.hasNext()) {
+    it.next();
+    const Edit &edit = it.value();
+    int start = starts.at(it.key());
+    write(data + pos, start - pos);
+    foreach (const QByteArray &text, edit.before)
+      write(text.constData(), text.length());
+
+    pos = lineEnd(it.key());
+    if (!edit.deleted)
+      write(data + start, pos - start);
+
+    foreach (const QByteArray &text, edit.after)
+      write(text.constData(), text.length());
+  }
+
+  write(data + pos, length - pos);
+
+  git_oid id;
+  if (!error)
+    error = git_odb_stream_finalize_write(&id, stream);
+
+  git_odb_stream_free(stream);
+  git_odb_free(odb);
+
+  if (error)
+    return Id();
+
+  if (size)
+    *size = total;
+
+  return id;
+}
+
 Patch Patch::fromBuffers(
   const QByteArray &oldBuffer,
   const QByteArray &newBuffer,
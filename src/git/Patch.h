@@ -15,6 +15,7 @@
 #include "git2/patch.h"
 #include <QBitArray>
 #include <QSharedPointer>
+#include <QVector>
 
 namespace git {
 
@@ -38,6 +39,30 @@ public:
     int deletions;
   };
 
+  struct Line
+  {
+    char origin;
+    int oldLine;
+    int newLine;
+    int offset;
+    int length;
+  };
+
+  // All lines of a hunk. Line content is stored back to
+  // back in one buffer and located by offset and length.
+  struct Hunk
+  {
+    QByteArray content;
+    QVector<Line> lines;
+
+    QByteArray lineContent(int line) const
+    {
+      const Line &ln = lines.at(line);
+      const char *data = content.constData() + ln.offset;
+      return QByteArray::fromRawData(data, ln.length);
+    }
+  };
+
   Patch();
 
   bool isValid() const { return !d.isNull(); }
@@ -63,6 +88,10 @@ public:
   int lineNumber(int index, int line, Diff::File file = Diff::NewFile) const;
   QByteArray lineContent(int index, int line) const;
 
+  // Get every line of the hunk at once. This is much faster
+  // than calling the per-line accessors for each line.
+  Hunk hunk(int index) const;
+
   ConflictResolution conflictResolution(int index);
   void setConflictResolution(int index, ConflictResolution resolution);
 
@@ -71,6 +100,11 @@ public:
     const QBitArray &hunks,
     const FilterList &filters = FilterList()) const;
 
+  // Apply the given hunk indexes to the old blob and write the result
+  // to the object database. The new blob is streamed from ranges of the
+  // old blob and the hunk content. Return a null id on failure.
+  Id applyToOdb(const QBitArray &hunks, size_t *size = nullptr) const;
+
   static Patch fromBuffers(
     const QByteArray &oldBuffer,
     const QByteArray &newBuffer,
@@ -94,6 +128,9 @@ private:
   QSharedPointer<git_patch> d;
   QList<ConflictHunk> mConflicts;
 
+  // Keep a pooled handle of the diff checked out.
+  QSharedPointer<git_repository> mHandle;
+
   friend class Diff;
 };
 
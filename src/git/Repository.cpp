@@ -32,7 +32,8 @@
 #include "git2/cherrypick.h"
 #include "git2/filter.h"
 #include "git2/global.h"
-#include "git2/ignore.h"
+#include "git2/graph.h"
+#include "git2/index.h"
 #include "git2/merge.h"
 #include "git2/rebase.h"
 #include "git2/refs.h"
@@ -42,6 +43,8 @@
 #include "git2/stash.h"
 #include "git2/tag.h"
 #include "git2/sys/repository.h"
+#include <QDataStream>
+#include <QFileInfo>
 #include <QJsonArray>
 #include <QJsonDocument>
 #include <QJsonObject>
@@ -64,6 +67,61 @@ namespace {
 const QString kConfigDir = "gitahead";
 const QString kConfigFile = "config";
 const QString kStarFile = "starred";
+const QString kChangedPathsFile = "changedpaths";
+const QString kAheadBehindFile = "aheadbehind";
+const QString kSignaturesFile = "signatures";
+const QString kUntrackedFile = "untracked";
+
+const int kAheadBehindLimit = 128;
+const int kStatusPathLimit = 4096;
+const int kSignaturesLimit = 8192;
+const int kUntrackedLimit = 4096;
+
+const quint32 kChangedPathsVersion = 2;
+const quint32 kSignaturesVersion = 2;
+const quint32 kUntrackedVersion = 2;
+
+const int kDefaultRenameTimeout = 2000; // ms
+
+const QDir::Filters kUntrackedFilters =
+  (QDir::AllEntries |
+   QDir::Hidden |
+   QDir::System |
+   QDir::NoDotAndDotDot);
+
+quint64 hash(
+  const void *data,
+  size_t length,
+  quint64 seed = 14695981039346656037u)
+{
+  // FNV-1a
+  quint64 result = seed;
+  const uchar *bytes = static_cast<const uchar *>(data);
+  for (size_t i = 0; i < length; ++i) {
+    result ^= bytes[i];
+    result *= 1099511628211u;
+  }
+
+  return result;
+}
+
+// Ignore and attribute rules can change the status of any path.
+bool isRulesFile(const QString &path)
+{
+  QString name = path.mid(path.lastIndexOf('/') + 1);
+  return (name == ".gitignore" || name == ".gitattributes" ||
+          path.startsWith(".git/info/"));
+}
+
+// The modification time and size of a file or directory.
+QPair<qint64,qint64> stamp(const QString &path)
+{
+  QFileInfo info(path);
+  if (!info.exists())
+    return {-1, -1};
+
+  return {info.lastModified().toMSecsSinceEpoch(), info.size()};
+}
 
 int blame_progress(const git_oid *suspect, void *payload)
 {
@@ -122,11 +180,29 @@ int append_submodule_name(git_submodule *, const char *name, void *payload)
 
 } // anon. namespace
 
+QMutex Repository::registryLock;
 QMap<git_repository *,QWeakPointer<Repository::Data>> Repository::registry;
 
 Repository::Data::Data(git_repository *repo)
-  : repo(repo), notifier(new RepositoryNotifier)
-{
+  : repo(repo), notifier(new RepositoryNotifier), ignore(repo)
+{
+  // Invalidate the ref index when references change. HEAD changes and
+  // refreshes are reported as updates. Workdir changes don't matter.
+  auto invalidate = [this] {
+    QMutexLocker locker(&refIndexLock);
+    refIndex.clear();
+    refIndexCached = false;
+    descriptions.clear();
+    ++descriptionsGeneration;
+  };
+
+  QObject::connect(notifier, &RepositoryNotifier::referenceAdded,
+                   notifier, invalidate);
+  QObject::connect(notifier, &RepositoryNotifier::referenceRemoved,
+                   notifier, invalidate);
+  QObject::connect(notifier, &RepositoryNotifier::referenceUpdated,
+                   notifier, invalidate);
+
   // Load starred commits.
   QDir dir(git_repository_path(repo));
   QFile file(appDir(dir).filePath(kStarFile));
@@ -143,13 +219,21 @@ Repository::Data::Data(git_repository *repo)
 
 Repository::Data::~Data()
 {
+  foreach (git_repository *handle, handles)
+    git_repository_free(handle);
+
   delete notifier;
   git_repository_free(repo);
 }
 
 void Repository::unregisterRepository(Data *data)
 {
+  QMutexLocker locker(&registryLock);
   registry.remove(data->repo);
+  foreach (git_repository *handle, data->handles)
+    registry.remove(handle);
+  locker.unlock();
+
   delete data;
 }
 
@@ -159,6 +243,7 @@ QSharedPointer<Repository::Data> Repository::registerRepository(
   if (!repo)
     return QSharedPointer<Data>();
 
+  QMutexLocker locker(&registryLock);
   auto it = registry.find(repo);
   if (it != registry.end())
     return *it;
@@ -179,6 +264,40 @@ Repository::operator git_repository *() const
   return d->repo;
 }
 
+git_repository *Repository::acquireHandle() const
+{
+  QMutexLocker locker(&d->handleLock);
+  if (!d->handles.isEmpty())
+    return d->handles.takeLast();
+
+  git_repository *repo = nullptr;
+  if (git_repository_open(&repo, git_repository_path(d->repo)))
+    return nullptr;
+
+  // Wrapping the handle yields this repository.
+  QMutexLocker registryLocker(&registryLock);
+  registry.insert(repo, d.toWeakRef());
+  return repo;
+}
+
+void Repository::releaseHandle(git_repository *repo) const
+{
+  QMutexLocker locker(&d->handleLock);
+  d->handles.append(repo);
+}
+
+QSharedPointer<git_repository> Repository::leaseHandle() const
+{
+  git_repository *repo = acquireHandle();
+  if (!repo)
+    return QSharedPointer<git_repository>();
+
+  Repository owner = *this;
+  return QSharedPointer<git_repository>(repo, [owner](git_repository *handle) {
+    owner.releaseHandle(handle);
+  });
+}
+
 QDir Repository::dir() const
 {
   return QDir(git_repository_path(d->repo));
@@ -266,9 +385,7 @@ Signature Repository::defaultSignature(bool *fake) const
 
 bool Repository::isIgnored(const QString &path) const
 {
-  int ignored = 0;
-  git_ignore_path_is_ignored(&ignored, d->repo, path.toUtf8());
-  return ignored;
+  return d->ignore.isIgnored(path);
 }
 
 Index Repository::index() const
@@ -283,6 +400,11 @@ void Repository::setIndex(const Index &index)
   git_repository_set_index(d->repo, index);
 }
 
+bool Repository::isStaging() const
+{
+  return d->staging;
+}
+
 Diff Repository::status(Diff::Callbacks *callbacks) const
 {
   Tree tree;
@@ -291,40 +413,220 @@ Diff Repository::status(Diff::Callbacks *callbacks) const
       tree = commit.tree();
   }
 
+  updateStatusIndex();
   Diff diff = diffTreeToIndex(tree);
   Diff workdir = diffIndexToWorkdir(callbacks);
   if (!diff.isValid() || !workdir.isValid())
     return Diff();
 
   diff.merge(workdir);
-  diff.findSimilar();
+  diff.findSimilar(*this, callbacks);
 
   return diff;
 }
 
-Diff Repository::diffTreeToIndex(const Tree &tree) const
+Diff Repository::status(
+  const Diff &previous,
+  const QStringList &paths,
+  Diff::Callbacks *callbacks) const
+{
+  foreach (const QString &path, paths) {
+    if (isRulesFile(path)) {
+      d->ignore.invalidate();
+      return status(callbacks);
+    }
+  }
+
+  // Compare paths that changed or that were already dirty.
+  QSet<QString> pathspec = paths.toSet();
+  if (previous.isValid()) {
+    int count = git_diff_num_deltas(previous);
+    for (int i = 0; i < count; ++i) {
+      const git_diff_delta *delta = git_diff_get_delta(previous, i);
+      pathspec.insert(delta->old_file.path);
+      pathspec.insert(delta->new_file.path);
+    }
+  }
+
+  // Compare paths whose index entries changed, e.g. after checkout.
+  if (!updateStatusIndex(&pathspec) || pathspec.size() > kStatusPathLimit)
+    return status(callbacks);
+
+  Tree tree;
+  if (Reference ref = head()) {
+    if (Commit commit = ref.target())
+      tree = commit.tree();
+  }
+
+  // The index is always compared in full. It doesn't touch the workdir.
+  Diff diff = diffTreeToIndex(tree);
+  if (!diff.isValid())
+    return Diff();
+
+  if (!pathspec.isEmpty()) {
+    Diff workdir = diffIndexToWorkdir(callbacks, pathspec.toList());
+    if (!workdir.isValid())
+      return Diff();
+
+    diff.merge(workdir);
+  }
+
+  diff.findSimilar(*this, callbacks);
+
+  return diff;
+}
+
+Diff Repository::diffTreeToIndex(
+  const Tree &tree,
+  const QStringList &paths) const
 {
   git_diff_options opts = GIT_DIFF_OPTIONS_INIT;
   opts.flags |= GIT_DIFF_INCLUDE_UNTRACKED;
 
+  // Limit the diff to exact paths.
+  QList<QByteArray> storage;
+  foreach (const QString &path, paths)
+    storage.append(path.toUtf8());
+
+  QVector<char *> strings;
+  for (int i = 0; i < storage.size(); ++i)
+    strings.append(storage[i].data());
+
+  if (!strings.isEmpty()) {
+    opts.pathspec.count = strings.size();
+    opts.pathspec.strings = strings.data();
+    opts.flags |= GIT_DIFF_DISABLE_PATHSPEC_MATCH;
+  }
+
   git_diff *diff = nullptr;
   git_diff_tree_to_index(&diff, d->repo, tree, nullptr, &opts);
   return Diff(diff);
 }
 
-Diff Repository::diffIndexToWorkdir(Diff::Callbacks *callbacks) const
+Diff Repository::diffIndexToWorkdir(
+  Diff::Callbacks *callbacks,
+  const QStringList &paths) const
 {
+  // Pick up changes to ignore files before filtering.
+  d->ignore.invalidate();
+
+  // Untracked directories aren't scanned by libgit2. Directories that
+  // only contain ignored files are filtered out below.
   git_diff_options opts = GIT_DIFF_OPTIONS_INIT;
   opts.flags |= (GIT_DIFF_INCLUDE_UNTRACKED | GIT_DIFF_DISABLE_MMAP);
+  opts.flags |= GIT_DIFF_ENABLE_FAST_UNTRACKED_DIRS;
 
   if (callbacks) {
     opts.progress_cb = &Diff::Callbacks::progress;
     opts.payload = callbacks;
   }
 
+  // Limit the diff to exact paths. Directories match everything
+  // below them. The workdir iterator skips everything else.
+  QList<QByteArray> storage;
+  foreach (const QString &path, paths)
+    storage.append(path.toUtf8());
+
+  QVector<char *> strings;
+  for (int i = 0; i < storage.size(); ++i)
+    strings.append(storage[i].data());
+
+  if (!strings.isEmpty()) {
+    opts.pathspec.count = strings.size();
+    opts.pathspec.strings = strings.data();
+    opts.flags |= GIT_DIFF_DISABLE_PATHSPEC_MATCH;
+  }
+
   git_diff *diff = nullptr;
-  git_diff_index_to_workdir(&diff, d->repo, nullptr, &opts);
-  return Diff(diff);
+  if (git_diff_index_to_workdir(&diff, d->repo, nullptr, &opts))
+    return Diff();
+
+  // Look up untracked directories in the cache.
+  bool filtered = false;
+  QStringList remaining;
+  int count = git_diff_num_deltas(diff);
+  for (int i = 0; i < count; ++i) {
+    const git_diff_delta *delta = git_diff_get_delta(diff, i);
+    QString path = delta->new_file.path;
+    if (delta->status == GIT_DELTA_UNTRACKED && path.endsWith('/')) {
+      if (isUntrackedDirIgnored(path)) {
+        filtered = true;
+        continue;
+      }
+
+      path.chop(1);
+    }
+
+    remaining.append(path);
+  }
+
+  if (!filtered)
+    return Diff(diff);
+
+  git_diff_free(diff);
+  storeUntrackedDirs();
+
+  // Everything was filtered. An empty path list would match all paths,
+  // so return an empty diff instead. Diffing two empty trees is free.
+  if (remaining.isEmpty()) {
+    git_diff *empty = nullptr;
+    git_diff_tree_to_tree(&empty, d->repo, nullptr, nullptr, &opts);
+    return Diff(empty);
+  }
+
+  // Diff only the remaining paths again.
+  return diffIndexToWorkdir(callbacks, remaining);
+}
+
+Diff Repository::diffCommit(
+  const Id &commit,
+  const Id &base,
+  int contextLines,
+  Diff::Callbacks *callbacks) const
+{
+  QSharedPointer<git_repository> handle = leaseHandle();
+  if (!handle)
+    return Diff();
+
+  git_repository *repo = handle.data();
+  git_commit *newCommit = nullptr;
+  git_commit *oldCommit = nullptr;
+  git_tree *newTree = nullptr;
+  git_tree *oldTree = nullptr;
+  git_diff *diff = nullptr;
+  if (!git_commit_lookup(&newCommit, repo, commit) &&
+      !git_commit_tree(&newTree, newCommit)) {
+    if (!base.isNull()) {
+      git_commit_lookup(&oldCommit, repo, base);
+    } else if (git_commit_parentcount(newCommit)) {
+      git_commit_parent(&oldCommit, newCommit, 0);
+    }
+
+    if (oldCommit)
+      git_commit_tree(&oldTree, oldCommit);
+
+    git_diff_options opts = GIT_DIFF_OPTIONS_INIT;
+    opts.context_lines = contextLines;
+    if (callbacks) {
+      opts.notify_cb = &Diff::Callbacks::notify;
+      opts.progress_cb = &Diff::Callbacks::progress;
+      opts.payload = callbacks;
+    }
+
+    git_diff_tree_to_tree(&diff, repo, oldTree, newTree, &opts);
+  }
+
+  git_tree_free(oldTree);
+  git_tree_free(newTree);
+  git_commit_free(oldCommit);
+  git_commit_free(newCommit);
+
+  // The diff and its patches keep the handle checked out.
+  Diff result(diff);
+  if (result.isValid())
+    result.d->handle = handle;
+
+  return result;
 }
 
 Reference Repository::head() const
@@ -386,6 +688,59 @@ QList<Reference> Repository::refs() const
   return refs;
 }
 
+QMultiHash<Id,QString> Repository::refIndex() const
+{
+  QMutexLocker locker(&d->refIndexLock);
+  if (d->refIndexCached)
+    return d->refIndex;
+
+  git_reference_iterator *it = nullptr;
+  if (git_reference_iterator_new(&it, d->repo))
+    return QMultiHash<Id,QString>();
+
+  // Peel each reference once.
+  git_reference *ref = nullptr;
+  while (!git_reference_next(&ref, it)) {
+    git_object *obj = nullptr;
+    if (!git_reference_peel(&obj, ref, GIT_OBJECT_COMMIT))
+      d->refIndex.insert(git_object_id(obj), git_reference_name(ref));
+
+    git_object_free(obj);
+    git_reference_free(ref);
+  }
+
+  git_reference_iterator_free(it);
+
+  d->refIndexCached = true;
+  return d->refIndex;
+}
+
+bool Repository::lookupDescription(
+  const Id &commit,
+  QString &description,
+  int &generation) const
+{
+  QMutexLocker locker(&d->refIndexLock);
+  generation = d->descriptionsGeneration;
+  auto it = d->descriptions.constFind(commit);
+  if (it == d->descriptions.constEnd())
+    return false;
+
+  description = *it;
+  return true;
+}
+
+void Repository::storeDescription(
+  const Id &commit,
+  const QString &description,
+  int generation) const
+{
+  // Don't store a result computed from refs that have since changed.
+  QMutexLocker locker(&d->refIndexLock);
+  if (generation == d->descriptionsGeneration)
+    d->descriptions.insert(commit, description);
+}
+
 Reference Repository::lookupRef(const QString &name) const
 {
   if (name.isEmpty())
@@ -624,6 +979,91 @@ void Repository::setCommitStarred(const Id &commit, bool starred)
   file.commit();
 }
 
+QHash<Id,BloomFilter> Repository::changedPathFilters() const
+{
+  QMutexLocker locker(&d->changedPathFiltersLock);
+  loadChangedPathFilters();
+  return d->changedPathFilters;
+}
+
+void Repository::addChangedPathFilters(const QHash<Id,BloomFilter> &filters)
+{
+  QMutexLocker locker(&d->changedPathFiltersLock);
+  loadChangedPathFilters();
+
+  QFile file(appDir().filePath(kChangedPathsFile));
+  if (!file.open(QIODevice::ReadWrite))
+    return;
+
+  // Drop an incomplete batch or start over with a new header.
+  QByteArray data;
+  QDataStream out(&data, QIODevice::WriteOnly);
+  if (d->changedPathFiltersSize) {
+    file.resize(d->changedPathFiltersSize);
+  } else {
+    file.resize(0);
+    out << kChangedPathsVersion;
+  }
+
+  QHash<Id,BloomFilter>::const_iterator it;
+  for (it = filters.constBegin(); it != filters.constEnd(); ++it)
+    out << it.key().toByteArray() << it.value().data();
+
+  // Append the batch with a single write.
+  if (!file.seek(file.size()) || file.write(data) != data.size())
+    return;
+
+  for (it = filters.constBegin(); it != filters.constEnd(); ++it)
+    d->changedPathFilters.insert(it.key(), it.value());
+  d->changedPathFiltersSize = file.size();
+}
+
+void Repository::loadChangedPathFilters() const
+{
+  // Read batches that were appended since the last call.
+  QFile file(appDir().filePath(kChangedPathsFile));
+  qint64 size = file.size();
+  if (size == d->changedPathFiltersSize)
+    return;
+
+  // Start over if the file was replaced.
+  qint64 offset = d->changedPathFiltersSize;
+  if (size < offset) {
+    d->changedPathFilters.clear();
+    d->changedPathFiltersSize = 0;
+    offset = 0;
+  }
+
+  if (!file.open(QIODevice::ReadOnly))
+    return;
+
+  QDataStream in(&file);
+  if (!offset) {
+    quint32 version = 0;
+    in >> version;
+    if (version != kChangedPathsVersion)
+      return;
+
+    offset = file.pos();
+  } else if (!file.seek(offset)) {
+    return;
+  }
+
+  // Stop at an incomplete entry. It's read again
+  // later if it was still being written.
+  while (!in.atEnd()) {
+    QByteArray id, data;
+    in >> id >> data;
+    if (in.status() != QDataStream::Ok)
+      break;
+
+    d->changedPathFilters.insert(id, data);
+    offset = file.pos();
+  }
+
+  d->changedPathFiltersSize = offset;
+}
+
 QList<Submodule> Repository::submodules() const
 {
   if (!d->submoduleNamesCached) {
@@ -815,6 +1255,464 @@ FilterList Repository::filters(const QString &path, const Blob &blob) const
   return FilterList(filters);
 }
 
+bool Repository::aheadBehind(
+  const Commit &local,
+  const Commit &upstream,
+  int &ahead,
+  int &behind) const
+{
+  if (cachedAheadBehind(local, upstream, ahead, behind))
+    return true;
+
+  git_repository *repo = acquireHandle();
+  if (!repo)
+    return false;
+
+  // This walks from both tips until the merge base is found.
+  size_t localCount = 0;
+  size_t upstreamCount = 0;
+  int error = git_graph_ahead_behind(
+    &localCount, &upstreamCount, repo, local.id(), upstream.id());
+  releaseHandle(repo);
+  if (error)
+    return false;
+
+  ahead = localCount;
+  behind = upstreamCount;
+
+  QMutexLocker locker(&d->aheadBehindLock);
+  d->aheadBehind.append({local.id(), upstream.id(), ahead, behind});
+  while (d->aheadBehind.size() > kAheadBehindLimit)
+    d->aheadBehind.removeFirst();
+
+  // Write to disk.
+  QSaveFile file(appDir().filePath(kAheadBehindFile));
+  if (!file.open(QIODevice::WriteOnly))
+    return true;
+
+  QDataStream out(&file);
+  out << quint32(d->aheadBehind.size());
+  foreach (const Data::AheadBehind &entry, d->aheadBehind) {
+    out << entry.local.toByteArray() << entry.upstream.toByteArray();
+    out << qint32(entry.ahead) << qint32(entry.behind);
+  }
+
+  file.commit();
+  return true;
+}
+
+bool Repository::cachedAheadBehind(
+  const Commit &local,
+  const Commit &upstream,
+  int &ahead,
+  int &behind) const
+{
+  if (!local.isValid() || !upstream.isValid())
+    return false;
+
+  // Check for the same commit.
+  if (local.id() == upstream.id()) {
+    ahead = 0;
+    behind = 0;
+    return true;
+  }
+
+  loadAheadBehind();
+
+  QMutexLocker locker(&d->aheadBehindLock);
+  foreach (const Data::AheadBehind &entry, d->aheadBehind) {
+    if (entry.local == local.id() && entry.upstream == upstream.id()) {
+      ahead = entry.ahead;
+      behind = entry.behind;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+bool Repository::walkDates(
+  const QList<Id> &tips,
+  const QList<Id> &hidden,
+  int sort,
+  const std::function<bool(const QDateTime &)> &callback) const
+{
+  git_repository *repo = acquireHandle();
+  if (!repo)
+    return false;
+
+  git_revwalk *walker = nullptr;
+  if (git_revwalk_new(&walker, repo)) {
+    releaseHandle(repo);
+    return false;
+  }
+
+  git_revwalk_sorting(walker, sort);
+  foreach (const Id &tip, tips)
+    git_revwalk_push(walker, tip);
+  foreach (const Id &id, hidden)
+    git_revwalk_hide(walker, id);
+
+  git_oid id;
+  while (!git_revwalk_next(&id, walker)) {
+    git_commit *commit = nullptr;
+    if (git_commit_lookup(&commit, repo, &id))
+      continue;
+
+    const git_signature *committer = git_commit_committer(commit);
+    int offset = committer->when.offset * 60;
+    QDateTime date =
+      QDateTime::fromTime_t(committer->when.time, Qt::OffsetFromUTC, offset);
+    git_commit_free(commit);
+
+    if (!callback(date))
+      break;
+  }
+
+  git_revwalk_free(walker);
+  releaseHandle(repo);
+  return true;
+}
+
+bool Repository::isDescendantOf(const Id &commit, const Id &ancestor) const
+{
+  git_repository *repo = acquireHandle();
+  if (!repo)
+    return false;
+
+  int result = git_graph_descendant_of(repo, commit, ancestor);
+  releaseHandle(repo);
+  return (result == 1);
+}
+
+void Repository::loadAheadBehind() const
+{
+  QMutexLocker locker(&d->aheadBehindLock);
+  if (d->aheadBehindCached)
+    return;
+
+  d->aheadBehindCached = true;
+
+  QFile file(appDir().filePath(kAheadBehindFile));
+  if (!file.open(QIODevice::ReadOnly))
+    return;
+
+  quint32 count;
+  QDataStream in(&file);
+  in >> count;
+  for (quint32 i = 0; i < count && in.status() == QDataStream::Ok; ++i) {
+    QByteArray local, upstream;
+    qint32 ahead, behind;
+    in >> local >> upstream >> ahead >> behind;
+    d->aheadBehind.append({local, upstream, ahead, behind});
+  }
+}
+
+bool Repository::lookupSimilaritySignature(
+  const Id &id,
+  QVector<quint32> &signature) const
+{
+  loadSimilaritySignatures();
+
+  QMutexLocker locker(&d->signatureLock);
+  auto it = d->signatures.constFind(id);
+  if (it == d->signatures.constEnd())
+    return false;
+
+  signature = it.value();
+  return true;
+}
+
+void Repository::addSimilaritySignatures(
+  const QHash<Id,QVector<quint32>> &signatures) const
+{
+  if (signatures.isEmpty())
+    return;
+
+  loadSimilaritySignatures();
+
+  QMutexLocker locker(&d->signatureLock);
+  QHashIterator<Id,QVector<quint32>> it(signatures);
+  while (it.hasNext()) {
+    it.next();
+    if (!d->signatures.contains(it.key()))
+      d->signatureOrder.append(it.key());
+    d->signatures.insert(it.key(), it.value());
+  }
+
+  // Evict the oldest entries.
+  while (d->signatureOrder.size() > kSignaturesLimit)
+    d->signatures.remove(d->signatureOrder.takeFirst());
+
+  // Append new signatures until the file holds too many stale records.
+  QString path = appDir().filePath(kSignaturesFile);
+  int records = d->signatureRecords + signatures.size();
+  if (d->signatureRecords > 0 && records <= 2 * kSignaturesLimit) {
+    QByteArray data;
+    QDataStream out(&data, QIODevice::WriteOnly);
+    for (it.toFront(); it.hasNext();) {
+      it.next();
+      out << it.key().toByteArray() << it.value();
+    }
+
+    QFile file(path);
+    if (file.open(QIODevice::Append) && file.write(data) == data.size())
+      d->signatureRecords = records;
+    return;
+  }
+
+  // Rewrite the file with only the current entries.
+  QSaveFile file(path);
+  if (!file.open(QIODevice::WriteOnly))
+    return;
+
+  QDataStream out(&file);
+  out << kSignaturesVersion;
+  foreach (const Id &id, d->signatureOrder)
+    out << id.toByteArray() << d->signatures.value(id);
+
+  if (file.commit())
+    d->signatureRecords = d->signatureOrder.size();
+}
+
+void Repository::loadSimilaritySignatures() const
+{
+  QMutexLocker locker(&d->signatureLock);
+  if (d->signaturesCached)
+    return;
+
+  d->signaturesCached = true;
+
+  QFile file(appDir().filePath(kSignaturesFile));
+  if (!file.open(QIODevice::ReadOnly))
+    return;
+
+  quint32 version;
+  QDataStream in(&file);
+  in >> version;
+  if (version != kSignaturesVersion)
+    return;
+
+  // Later records replace earlier ones. Stop at an incomplete record.
+  int records = 0;
+  while (!in.atEnd()) {
+    QByteArray id;
+    QVector<quint32> signature;
+    in >> id >> signature;
+    if (in.status() != QDataStream::Ok)
+      break;
+
+    ++records;
+    if (!d->signatures.contains(id))
+      d->signatureOrder.append(id);
+    d->signatures.insert(id, signature);
+  }
+
+  while (d->signatureOrder.size() > kSignaturesLimit)
+    d->signatures.remove(d->signatureOrder.takeFirst());
+
+  // A truncated file is rewritten on the next add.
+  d->signatureRecords = in.atEnd() ? records : 0;
+}
+
+void Repository::renameOptions(
+  int &limit,
+  int &threshold,
+  int &timeout) const
+{
+  QMutexLocker locker(&d->renameOptionsLock);
+  if (!d->renameOptionsCached) {
+    Config config = appConfig();
+    d->renameLimit = config.value<int>("diff.renames.limit", 0);
+    d->renameThreshold = config.value<int>("diff.renames.threshold", 0);
+    d->renameTimeout =
+      config.value<int>("diff.renames.timeout", kDefaultRenameTimeout);
+    d->renameOptionsCached = true;
+  }
+
+  limit = d->renameLimit;
+  threshold = d->renameThreshold;
+  timeout = d->renameTimeout;
+}
+
+bool Repository::updateStatusIndex(QSet<QString> *changed) const
+{
+  git_index *index = nullptr;
+  if (git_repository_index(&index, d->repo))
+    return false;
+
+  // Entries are compared by their stat data like the workdir diff does.
+  git_index_read(index, false);
+  QHash<quint64,quint64> entries;
+  QList<QPair<quint64,QString>> paths;
+  size_t count = git_index_entrycount(index);
+  entries.reserve(count);
+  for (size_t i = 0; i < count; ++i) {
+    const git_index_entry *entry = git_index_get_byindex(index, i);
+    int stage = git_index_entry_stage(entry);
+    quint64 key = hash(entry->path, strlen(entry->path));
+    key = hash(&stage, sizeof(stage), key);
+
+    quint64 value = hash(&entry->id, sizeof(entry->id));
+    value = hash(&entry->mode, sizeof(entry->mode), value);
+    value = hash(&entry->file_size, sizeof(entry->file_size), value);
+    value = hash(&entry->mtime, sizeof(entry->mtime), value);
+    value = hash(&entry->ctime, sizeof(entry->ctime), value);
+    value = hash(&entry->ino, sizeof(entry->ino), value);
+    value = hash(&entry->dev, sizeof(entry->dev), value);
+    entries.insert(key, value);
+
+    if (changed)
+      paths.append({key, entry->path});
+  }
+
+  git_index_free(index);
+
+  QMutexLocker locker(&d->statusIndexLock);
+  bool valid = d->statusIndexValid;
+  if (changed && valid) {
+    int matched = 0;
+    foreach (const auto &pair, paths) {
+      auto it = d->statusIndex.constFind(pair.first);
+      if (it == d->statusIndex.constEnd()) {
+        changed->insert(pair.second);
+      } else {
+        ++matched;
+        if (it.value() != entries.value(pair.first))
+          changed->insert(pair.second);
+      }
+    }
+
+    // The paths of removed entries are unknown.
+    if (matched < d->statusIndex.size())
+      valid = false;
+  }
+
+  d->statusIndex = entries;
+  d->statusIndexValid = true;
+  return valid;
+}
+
+bool Repository::isUntrackedDirIgnored(const QString &path) const
+{
+  loadUntrackedDirs();
+
+  QString workdir = this->workdir().path() + '/';
+  QMutexLocker locker(&d->untrackedLock);
+  auto it = d->untracked.constFind(path);
+  if (it != d->untracked.constEnd()) {
+    bool valid = true;
+    QHashIterator<QString,QPair<qint64,qint64>> stamps(it.value().stamps);
+    while (valid && stamps.hasNext()) {
+      stamps.next();
+      valid = (stamp(stamps.key()) == stamps.value());
+    }
+
+    if (valid)
+      return it.value().ignored;
+  }
+
+  locker.unlock();
+
+  // Global ignore files and ignore files in parent
+  // directories apply to the whole directory.
+  Data::UntrackedDir entry;
+  entry.ignored = true;
+  foreach (const QString &file, d->ignore.globalFiles())
+    entry.stamps.insert(file, stamp(file));
+
+  QString parent = workdir;
+  foreach (const QString &name, path.split('/', QString::SkipEmptyParts)) {
+    QString ignore = parent + ".gitignore";
+    entry.stamps.insert(ignore, stamp(ignore));
+    parent += name + '/';
+  }
+
+  // Walk breadth-first until a file that isn't ignored is found. Every
+  // dir that was read is recorded because adding or removing entries
+  // changes its modification time. Ignore files inside are recorded
+  // too because editing them doesn't.
+  QStringList queue(path);
+  while (entry.ignored && !queue.isEmpty()) {
+    QString subdir = queue.takeFirst();
+    QString absolute = workdir + subdir;
+    QString ignore = absolute + ".gitignore";
+    entry.stamps.insert(absolute, stamp(absolute));
+    entry.stamps.insert(ignore, stamp(ignore));
+    QDir current(absolute);
+    foreach (const QFileInfo &info, current.entryInfoList(kUntrackedFilters)) {
+      QString name = subdir + info.fileName();
+      if (info.isDir() && !info.isSymLink()) {
+        if (!isIgnored(name + '/'))
+          queue.append(name + '/');
+      } else if (!isIgnored(name)) {
+        entry.ignored = false;
+        break;
+      }
+    }
+  }
+
+  locker.relock();
+  if (d->untracked.size() >= kUntrackedLimit)
+    d->untracked.erase(d->untracked.begin());
+  d->untracked.insert(path, entry);
+  d->untrackedChanged = true;
+
+  return entry.ignored;
+}
+
+void Repository::storeUntrackedDirs() const
+{
+  QMutexLocker locker(&d->untrackedLock);
+  if (!d->untrackedChanged)
+    return;
+
+  d->untrackedChanged = false;
+
+  QSaveFile file(appDir().filePath(kUntrackedFile));
+  if (!file.open(QIODevice::WriteOnly))
+    return;
+
+  QDataStream out(&file);
+  out << kUntrackedVersion << quint32(d->untracked.size());
+  QHashIterator<QString,Data::UntrackedDir> it(d->untracked);
+  while (it.hasNext()) {
+    it.next();
+    out << it.key() << it.value().ignored << it.value().stamps;
+  }
+
+  file.commit();
+}
+
+void Repository::loadUntrackedDirs() const
+{
+  QMutexLocker locker(&d->untrackedLock);
+  if (d->untrackedCached)
+    return;
+
+  d->untrackedCached = true;
+
+  QFile file(appDir().filePath(kUntrackedFile));
+  if (!file.open(QIODevice::ReadOnly))
+    return;
+
+  quint32 version, count;
+  QDataStream in(&file);
+  in >> version >> count;
+  if (version != kUntrackedVersion)
+    return;
+
+  for (quint32 i = 0; i < count && in.status() == QDataStream::Ok; ++i) {
+    QString path;
+    Data::UntrackedDir dir;
+    in >> path >> dir.ignored >> dir.stamps;
+    if (in.status() != QDataStream::Ok)
+      break;
+
+    d->untracked.insert(path, dir);
+  }
+}
+
 Commit Repository::mergeBase(const Commit &lhs, const Commit &rhs) const
 {
   git_oid id;
@@ -923,6 +1821,11 @@ QString Repository::decode(const QByteArray &text) const
   return codec()->toUnicode(text);
 }
 
+bool Repository::isUtf8() const
+{
+  return (codec()->mibEnum() == 106);
+}
+
 bool Repository::lfsIsInitialized()
 {
   return dir().exists("hooks/pre-push");
@@ -13,17 +13,24 @@
 #include "AnnotatedCommit.h"
 #include "Blame.h"
 #include "Blob.h"
+#include "BloomFilter.h"
 #include "Commit.h"
 #include "Diff.h"
+#include "Ignore.h"
 #include "git2/checkout.h"
 #include "git2/errors.h"
 #include "git2/revwalk.h"
 #include "git2/types.h"
 #include <QCoreApplication>
+#include <QDateTime>
 #include <QDir>
+#include <QMutex>
 #include <QObject>
+#include <QPair>
 #include <QSet>
 #include <QSharedPointer>
+#include <QVector>
+#include <functional>
 
 struct git_repository;
 class QProcess;
@@ -98,10 +105,39 @@ public:
   Index index() const;
   void setIndex(const Index &index);
 
+  // Many files are being staged in the background.
+  bool isStaging() const;
+
   // status/diff
   Diff status(Diff::Callbacks *callbacks) const;
-  Diff diffTreeToIndex(const Tree &tree) const;
-  Diff diffIndexToWorkdir(Diff::Callbacks *callbacks = nullptr) const;
+  Diff diffTreeToIndex(
+    const Tree &tree,
+    const QStringList &paths = QStringList()) const;
+  Diff diffIndexToWorkdir(
+    Diff::Callbacks *callbacks = nullptr,
+    const QStringList &paths = QStringList()) const;
+
+  // Diff a commit against base, or against its first parent if base
+  // is null. Objects are looked up on a separate handle, so this is
+  // safe to call from a worker thread. The diff and its patches keep
+  // the handle checked out.
+  Diff diffCommit(
+    const Id &commit,
+    const Id &base = Id(),
+    int contextLines = -1,
+    Diff::Callbacks *callbacks = nullptr) const;
+
+  // Update a previous status diff after the given workdir paths changed.
+  // Only the changed paths, paths that were already in the previous
+  // status and paths whose index entries changed since the last status
+  // are compared to the workdir. The rest of the workdir is assumed to
+  // be unchanged. This falls back to a full status if there are too
+  // many paths to compare, if index entries were removed or if an
+  // ignore or attributes file changed.
+  Diff status(
+    const Diff &previous,
+    const QStringList &paths,
+    Diff::Callbacks *callbacks) const;
 
   // refs
   QList<Reference> refs() const;
@@ -146,6 +182,11 @@ public:
   bool isCommitStarred(const Id &commit) const;
   void setCommitStarred(const Id &commit, bool starred);
 
+  // Get precomputed changed path filters keyed by commit id. Filters
+  // are appended in batches. This is safe to call from any thread.
+  QHash<Id,BloomFilter> changedPathFilters() const;
+  void addChangedPathFilters(const QHash<Id,BloomFilter> &filters);
+
   // submodule
   QList<Submodule> submodules() const;
   Submodule lookupSubmodule(const QString &path) const;
@@ -175,6 +216,37 @@ public:
   // filter
   FilterList filters(const QString &path, const Blob &blob = Blob()) const;
 
+  // Count the commits that are only reachable from local (ahead) and
+  // only reachable from upstream (behind). Results are cached on disk.
+  // This uses a separate repository handle and is safe to call from a
+  // worker thread.
+  bool aheadBehind(
+    const Commit &local,
+    const Commit &upstream,
+    int &ahead,
+    int &behind) const;
+
+  // Look up ahead/behind counts without computing them.
+  bool cachedAheadBehind(
+    const Commit &local,
+    const Commit &upstream,
+    int &ahead,
+    int &behind) const;
+
+  // Walk commits that are reachable from the tips but not from the
+  // hidden commits. The callback gets the committer date of each commit
+  // and returns false to stop. This uses a separate repository handle
+  // and is safe to call from a worker thread.
+  bool walkDates(
+    const QList<Id> &tips,
+    const QList<Id> &hidden,
+    int sort,
+    const std::function<bool(const QDateTime &)> &callback) const;
+
+  // This uses a separate repository handle and
+  // is safe to call from a worker thread.
+  bool isDescendantOf(const Id &commit, const Id &ancestor) const;
+
   // merge/rebase
   Commit mergeBase(const Commit &lhs, const Commit &rhs) const;
   bool merge(const AnnotatedCommit &mergeHead);
@@ -198,6 +270,9 @@ public:
   QTextCodec *codec() const;
   QString decode(const QByteArray &text) const;
 
+  // Text in UTF-8 can be passed to the editor without decoding.
+  bool isUtf8() const;
+
   // clean
   bool clean(const QString &name);
 
@@ -245,12 +320,136 @@ private:
     QSet<QString> lfsLocks;
     bool lfsLocksCached = false;
 
+    // Many files are staged in the background. Only one staging
+    // operation runs at a time. Other requests wait in the queue.
+    bool staging = false;
+    QList<std::function<void()>> stagingQueue;
+
     QSet<Id> starredCommits;
+
+    // The side file is append-only. The size is the offset
+    // of the end of the last complete batch that was read.
+    QMutex changedPathFiltersLock;
+    QHash<Id,BloomFilter> changedPathFilters;
+    qint64 changedPathFiltersSize = 0;
+
+    QMutex handleLock;
+    QList<git_repository *> handles;
+
+    struct AheadBehind
+    {
+      Id local;
+      Id upstream;
+      int ahead;
+      int behind;
+    };
+
+    QMutex aheadBehindLock;
+    QList<AheadBehind> aheadBehind;
+    bool aheadBehindCached = false;
+
+    // Similarity signatures of blob content in insertion order. New
+    // signatures are appended to the side file. It's compacted when
+    // the number of records grows well past the limit.
+    QMutex signatureLock;
+    QHash<Id,QVector<quint32>> signatures;
+    QList<Id> signatureOrder;
+    bool signaturesCached = false;
+    int signatureRecords = 0;
+
+    // Rename detection options read from the app config once.
+    QMutex renameOptionsLock;
+    bool renameOptionsCached = false;
+    int renameLimit = 0;
+    int renameThreshold = 0;
+    int renameTimeout = 0;
+
+    // Hashes of index entries keyed by path hash as of the last status.
+    QMutex statusIndexLock;
+    QHash<quint64,quint64> statusIndex;
+    bool statusIndexValid = false;
+
+    // Untracked directories keyed by path. A directory is ignored if it
+    // only contains ignored files. Entries are valid while the recorded
+    // modification times and sizes of directories and all applicable
+    // ignore files still match.
+    struct UntrackedDir
+    {
+      bool ignored;
+      QHash<QString,QPair<qint64,qint64>> stamps;
+    };
+
+    QMutex untrackedLock;
+    QHash<QString,UntrackedDir> untracked;
+    bool untrackedCached = false;
+    bool untrackedChanged = false;
+
+    // The ref index and descriptions are invalidated
+    // whenever the notifier reports a reference change.
+    QMutex refIndexLock;
+    QMultiHash<Id,QString> refIndex;
+    bool refIndexCached = false;
+    QHash<Id,QString> descriptions;
+    int descriptionsGeneration = 0;
+
+    // Compiled ignore rules shared with the watcher thread.
+    Ignore ignore;
   };
 
   Repository(git_repository *repo);
   operator git_repository *() const;
 
+  // Borrow a separate handle to this repository for use on a worker
+  // thread. Handles are reused once they are returned to the pool.
+  git_repository *acquireHandle() const;
+  void releaseHandle(git_repository *repo) const;
+
+  // Check out a handle until the last reference goes away.
+  QSharedPointer<git_repository> leaseHandle() const;
+
+  void loadAheadBehind() const;
+
+  // Read changed path filters. The caller must hold the lock.
+  void loadChangedPathFilters() const;
+
+  // Similarity signatures of blobs used for rename detection. Results
+  // are cached on disk. This is safe to call from a worker thread.
+  bool lookupSimilaritySignature(
+    const Id &id,
+    QVector<quint32> &signature) const;
+  void addSimilaritySignatures(
+    const QHash<Id,QVector<quint32>> &signatures) const;
+  void loadSimilaritySignatures() const;
+
+  // Get the rename limit, threshold and time budget in milliseconds.
+  void renameOptions(int &limit, int &threshold, int &timeout) const;
+
+  // Snapshot the index entries as of this status. Add paths of entries
+  // that changed since the last snapshot to changed. Return false if
+  // the changes can't be determined. This is safe to call from a
+  // worker thread.
+  bool updateStatusIndex(QSet<QString> *changed = nullptr) const;
+
+  // Check if an untracked directory only contains ignored files. Results
+  // are cached on disk. This is safe to call from a worker thread.
+  bool isUntrackedDirIgnored(const QString &path) const;
+  void storeUntrackedDirs() const;
+  void loadUntrackedDirs() const;
+
+  // Get the qualified names of references keyed by the commit that
+  // they point to. This is safe to call from a worker thread.
+  QMultiHash<Id,QString> refIndex() const;
+
+  // memoized commit descriptions
+  bool lookupDescription(
+    const Id &commit,
+    QString &description,
+    int &generation) const;
+  void storeDescription(
+    const Id &commit,
+    const QString &description,
+    int generation) const;
+
   QByteArray lfsExecute(
     const QStringList &args,
     const QByteArray &input = QByteArray()) const;
@@ -260,17 +459,21 @@ private:
 
   QSharedPointer<Data> d;
 
+  // Pooled handles map to the data of their repository.
+  static QMutex registryLock;
   static QMap<git_repository *,QWeakPointer<Data>> registry;
 
   friend class Branch;
   friend class Commit;
   friend class Config;
+  friend class Diff;
   friend class Index;
   friend class Object;
   friend class Patch;
   friend class Rebase;
   friend class Reference;
   friend class Remote;
+  friend class RevWalk;
   friend class Submodule;
   friend class TagRef;
 };
@@ -295,7 +498,10 @@ signals:
   void remoteRemoved(const QString &name);
 
   void stateChanged();
-  void workdirChanged();
+
+  // The paths are relative to the workdir. An empty
+  // list means that anything in the workdir may have changed.
+  void workdirChanged(const QStringList &paths = QStringList());
 
   void directoryStaged();
   void directoryAboutToBeStaged(
@@ -305,6 +511,14 @@ signals:
   void indexChanged(const QStringList &paths, bool yieldFocus = true);
   void indexStageError(const QString &path);
 
+  // Progress of adding many files. The value reaches the total
+  // when adding finishes or is canceled.
+  void indexStageProgress(int value, int total, bool &canceled);
+
+  // Staging many files started or finished. Commits
+  // should wait until the index is written.
+  void indexStagingChanged(bool staging);
+
   void lfsNotFound();
   void lfsLocksChanged();
 };
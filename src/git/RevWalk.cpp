@@ -8,25 +8,148 @@
 //
 
 #include "RevWalk.h"
+#include "BloomFilter.h"
 #include "Commit.h"
 #include "Reference.h"
+#include "Repository.h"
 #include "git2/commit.h"
 #include "git2/pathspec.h"
 #include "git2/revwalk.h"
 #include <QRegularExpression>
+#include <QtConcurrent>
 
 namespace git {
 
 namespace {
 
+const int kMinBatchSize = 64;
+const int kMaxBatchSize = 4096;
+
 int notify(const git_diff *, const git_diff_delta *, const char *, void *)
 {
   // Abort the diff.
   return -1;
 }
 
+// Diff options that abort as soon as the pathspec matches a delta.
+// The options refer to the given buffer, which must outlive them.
+git_diff_options pathspecOptions(const QString &path, char **data)
+{
+  git_diff_options diffopts = GIT_DIFF_OPTIONS_INIT;
+  diffopts.notify_cb = notify;
+
+  if (!path.isEmpty()) {
+    diffopts.pathspec.count = 1;
+    diffopts.pathspec.strings = data;
+    if (!path.contains(QRegularExpression("[*?]")))
+      diffopts.flags |= GIT_DIFF_DISABLE_PATHSPEC_MATCH;
+  }
+
+  return diffopts;
+}
+
+// Test whether the commit changes the pathspec. This
+// doesn't touch any shared state and is safe to call
+// concurrently with commits from different repositories.
+bool matches(
+  git_commit *commit,
+  const git_diff_options &diffopts,
+  const QString &path,
+  const QHash<Id,BloomFilter> &filters)
+{
+  // Skip the tree diff if the path definitely didn't change.
+  if (git_commit_parentcount(commit) <= 1 && !filters.isEmpty()) {
+    BloomFilter filter = filters.value(git_commit_id(commit));
+    if (filter.isValid() && !filter.containsPath(path))
+      return false;
+  }
+
+  switch (git_commit_parentcount(commit)) {
+    case 0: {
+      git_pathspec *pathspec = nullptr;
+      git_pathspec_new(&pathspec, &diffopts.pathspec);
+
+      int flags = GIT_PATHSPEC_NO_MATCH_ERROR;
+      if (diffopts.flags & GIT_DIFF_DISABLE_PATHSPEC_MATCH)
+        flags |= GIT_PATHSPEC_NO_GLOB;
+
+      git_tree *tree;
+      git_commit_tree(&tree, commit);
+      bool filter = git_pathspec_match_tree(nullptr, tree, flags, pathspec);
+
+      git_tree_free(tree);
+      git_pathspec_free(pathspec);
+
+      return !filter;
+    }
+
+    case 1: {
+      git_commit *parent;
+      git_commit_parent(&parent, commit, 0);
+
+      git_tree *a, *b;
+      git_commit_tree(&a, parent);
+      git_commit_tree(&b, commit);
+
+      git_diff *diff;
+      git_repository *repo = git_commit_owner(commit);
+      bool filter = !git_diff_tree_to_tree(&diff, repo, a, b, &diffopts);
+
+      git_diff_free(diff);
+      git_tree_free(a);
+      git_tree_free(b);
+      git_commit_free(parent);
+
+      return !filter;
+    }
+
+    default:
+      // Filter merges.
+      return false;
+  }
+}
+
 } // anon. namespace
 
+class RevWalk::Match
+{
+public:
+  typedef bool result_type;
+
+  Match(
+    const Repository &repo,
+    const QString &path,
+    const QHash<Id,BloomFilter> &filters)
+    : mRepo(repo), mPath(path), mFilters(filters)
+  {}
+
+  bool operator()(const git_oid &id) const
+  {
+    // Each worker uses its own repository handle.
+    QByteArray buffer = mPath.toUtf8();
+    char *data = buffer.data();
+    git_diff_options diffopts = pathspecOptions(mPath, &data);
+
+    git_repository *repo = mRepo.acquireHandle();
+    if (!repo)
+      return false;
+
+    git_commit *commit = nullptr;
+    git_commit_lookup(&commit, repo, &id);
+
+    bool result = commit && matches(commit, diffopts, mPath, mFilters);
+
+    git_commit_free(commit);
+    mRepo.releaseHandle(repo);
+    return result;
+  }
+
+private:
+  Repository mRepo;
+  QString mPath;
+  const QHash<Id,BloomFilter> &mFilters;
+};
+
 RevWalk::RevWalk() {}
 
 RevWalk::RevWalk(git_revwalk *walker)
@@ -57,18 +180,15 @@ bool RevWalk::push(const Reference &ref)
 
 Commit RevWalk::next(const QString &path) const
 {
-  git_diff_options diffopts = GIT_DIFF_OPTIONS_INIT;
-  diffopts.notify_cb = notify;
-
   // Convert pathspec to UTF-8.
   QByteArray buffer = path.toUtf8();
   char *data = buffer.data();
-  if (!path.isEmpty()) {
-    diffopts.pathspec.count = 1;
-    diffopts.pathspec.strings = &data;
-    if (!path.contains(QRegularExpression("[*?]")))
-      diffopts.flags |= GIT_DIFF_DISABLE_PATHSPEC_MATCH;
-  }
+  git_diff_options diffopts = pathspecOptions(path, &data);
+
+  // Literal paths can be ruled out by changed path filters.
+  QHash<Id,BloomFilter> filters;
+  if (diffopts.flags & GIT_DIFF_DISABLE_PATHSPEC_MATCH)
+    filters = this->filters();
 
   git_oid id;
   while (!git_revwalk_next(&id, d.data())) {
@@ -76,63 +196,78 @@ Commit RevWalk::next(const QString &path) const
     git_commit_lookup(&commit, git_revwalk_repository(d.data()), &id);
     Q_ASSERT(commit);
 
-    if (path.isEmpty())
+    if (path.isEmpty() || matches(commit, diffopts, path, filters))
       return Commit(commit);
 
-    switch (git_commit_parentcount(commit)) {
-      case 0: {
-        git_pathspec *pathspec = nullptr;
-        git_pathspec_new(&pathspec, &diffopts.pathspec);
+    git_commit_free(commit);
+  }
 
-        int flags = GIT_PATHSPEC_NO_MATCH_ERROR;
-        if (diffopts.flags & GIT_DIFF_DISABLE_PATHSPEC_MATCH)
-          flags |= GIT_PATHSPEC_NO_GLOB;
+  return Commit();
+}
 
-        git_tree *tree;
-        git_commit_tree(&tree, commit);
-        bool filter = git_pathspec_match_tree(nullptr, tree, flags, pathspec);
+QList<Commit> RevWalk::next(const QString &path, int count) const
+{
+  QList<Commit> commits;
+  if (path.isEmpty()) {
+    Commit commit = next();
+    while (commit.isValid() && commits.size() < count) {
+      commits.append(commit);
+      if (commits.size() < count)
+        commit = next();
+    }
 
-        git_tree_free(tree);
-        git_pathspec_free(pathspec);
+    return commits;
+  }
 
-        if (!filter)
-          return Commit(commit);
+  Repository repo = this->repo();
+  QHash<Id,BloomFilter> filters;
+  if (!path.contains(QRegularExpression("[*?]")))
+    filters = this->filters();
 
+  // Pull batches of ids off of the walk in order and test them
+  // concurrently. The mapped results come back in walk order.
+  bool done = false;
+  int size = kMinBatchSize;
+  Match match(repo, path, filters);
+  while (!done && commits.size() < count) {
+    QList<git_oid> ids;
+    while (ids.size() < size) {
+      git_oid id;
+      if (git_revwalk_next(&id, d.data())) {
+        done = true;
         break;
       }
 
-      case 1: {
-        git_commit *parent;
-        git_commit_parent(&parent, commit, 0);
-
-        git_tree *a, *b;
-        git_commit_tree(&a, parent);
-        git_commit_tree(&b, commit);
-
-        git_diff *diff;
-        git_repository *repo = git_commit_owner(commit);
-        bool filter = !git_diff_tree_to_tree(&diff, repo, a, b, &diffopts);
+      ids.append(id);
+    }
 
-        git_diff_free(diff);
-        git_tree_free(a);
-        git_tree_free(b);
-        git_commit_free(parent);
+    QList<bool> results =
+      QtConcurrent::blockingMapped<QList<bool>>(ids, match);
+    for (int i = 0; i < ids.size(); ++i) {
+      if (results.at(i))
+        commits.append(repo.lookupCommit(ids.at(i)));
+    }
 
-        if (!filter)
-          return Commit(commit);
+    // Matches are sparse in most histories. Grow the batch.
+    size = qMin(size * 2, kMaxBatchSize);
+  }
 
-        break;
-      }
+  return commits;
+}
 
-      default:
-        // Filter merges.
-        break;
-    }
+Repository RevWalk::repo() const
+{
+  return Repository(git_revwalk_repository(d.data()));
+}
 
-    git_commit_free(commit);
+const QHash<Id,BloomFilter> &RevWalk::filters() const
+{
+  if (!mFiltersLoaded) {
+    mFilters = repo().changedPathFilters();
+    mFiltersLoaded = true;
   }
 
-  return Commit();
+  return mFilters;
 }
 
 } // namespace git
@@ -10,6 +10,10 @@
 #ifndef REVWALK_H
 #define REVWALK_H
 
+#include "BloomFilter.h"
+#include "Id.h"
+#include <QHash>
+#include <QList>
 #include <QSharedPointer>
 
 struct git_revwalk;
@@ -18,6 +22,7 @@ namespace git {
 
 class Commit;
 class Reference;
+class Repository;
 
 class RevWalk
 {
@@ -35,11 +40,27 @@ public:
   // Return the next commit that matches the given pathspec.
   Commit next(const QString &pathspec = QString()) const;
 
+  // Return at least count commits that match the given pathspec in
+  // walk order, or fewer if the walk ends. Commits are tested on
+  // multiple threads, so this may return more than count commits.
+  QList<Commit> next(const QString &pathspec, int count) const;
+
 protected:
   RevWalk(git_revwalk *walker);
 
+  Repository repo() const;
+
   QSharedPointer<git_revwalk> d;
 
+private:
+  class Match;
+
+  // Load changed path filters once per walk.
+  const QHash<Id,BloomFilter> &filters() const;
+
+  mutable QHash<Id,BloomFilter> mFilters;
+  mutable bool mFiltersLoaded = false;
+
   friend class Commit;
   friend class Reference;
   friend class Repository;
@@ -11,6 +11,7 @@
 #include "GenericLexer.h"
 #include "LPegLexer.h"
 #include "conf/Settings.h"
+#include "git/BloomFilter.h"
 #include "git/Config.h"
 #include "git/Index.h"
 #include "git/Patch.h"
@@ -126,6 +127,7 @@ struct Intermediate
 
   git::Id id;
   FieldMap fields;
+  git::BloomFilter paths;
 };
 
 void index(
@@ -221,8 +223,12 @@ class Map
 public:
   typedef Intermediate result_type;
 
-  Map(const git::Repository &repo, LexerPool &lexers, QFile *out)
-    : mLexers(lexers), mOut(out)
+  Map(
+    const git::Repository &repo,
+    LexerPool &lexers,
+    const QSet<git::Id> &indexed,
+    QFile *out)
+    : mLexers(lexers), mIndexed(indexed), mOut(out)
   {
     git::Config config = repo.appConfig();
     mTermLimit = config.value<int>("index.termlimit", mTermLimit);
@@ -239,6 +245,20 @@ public:
     Intermediate result;
     result.id = commit.id();
 
+    // Record changed paths.
+    git::Diff diff = commit.diff(git::Commit(), mContextLines);
+    int patches = diff.count();
+
+    QStringList paths;
+    for (int pidx = 0; pidx < patches; ++pidx)
+      paths.append(diff.name(pidx));
+    result.paths = git::BloomFilter::changedPaths(paths);
+
+    // Commits that were indexed before changed path
+    // filters existed only need the filter.
+    if (mIndexed.contains(result.id))
+      return result;
+
     // Index id.
     result.fields[Index::Id][commit.id().toString().toUtf8()].append(0);
 
@@ -267,8 +287,6 @@ public:
 
     // Index diff.
     quint32 diffPos = 0;
-    git::Diff diff = commit.diff(git::Commit(), mContextLines);
-    int patches = diff.count();
     for (int pidx = 0; pidx < patches; ++pidx) {
       // Truncate commits after term limit.
       if (canceled || diffPos > mTermLimit)
@@ -306,20 +324,21 @@ public:
         }
 
         // Index content.
-        int lines = patch.lineCount(hidx);
+        git::Patch::Hunk hunk = patch.hunk(hidx);
+        int lines = hunk.lines.size();
         for (int line = 0; line < lines; ++line) {
           if (canceled || diffPos > mTermLimit)
             break;
 
           Index::Field field;
-          switch (patch.lineOrigin(hidx, line)) {
+          switch (hunk.lines.at(line).origin) {
             case GIT_DIFF_LINE_CONTEXT:  field = Index::Context;  break;
             case GIT_DIFF_LINE_ADDITION: field = Index::Addition; break;
             case GIT_DIFF_LINE_DELETION: field = Index::Deletion; break;
             default: continue;
           }
 
-          if (lexer->lex(patch.lineContent(hidx, line))) {
+          if (lexer->lex(hunk.lineContent(line))) {
             while (!canceled && lexer->hasNext())
               index(lexer->next(), result.fields, field, diffPos);
           }
@@ -336,6 +355,7 @@ public:
 
 private:
   LexerPool &mLexers;
+  const QSet<git::Id> &mIndexed;
   QFile *mOut;
 
   int mContextLines = 3;
@@ -345,13 +365,22 @@ private:
 class Reduce
 {
 public:
-  Reduce(Index::IdList &ids, QFile *out)
-    : mIds(ids), mOut(out)
+  Reduce(
+    Index::IdList &ids,
+    QHash<git::Id,git::BloomFilter> &filters,
+    QFile *out)
+    : mIds(ids), mFilters(filters), mOut(out)
   {}
 
   void operator()(Index::PostingMap &result, const Intermediate &intermediate)
   {
-    if (canceled || intermediate.fields.isEmpty())
+    if (canceled)
+      return;
+
+    if (intermediate.paths.isValid())
+      mFilters.insert(intermediate.id, intermediate.paths);
+
+    if (intermediate.fields.isEmpty())
       return;
 
     log(mOut, "reduce: %1", intermediate.id);
@@ -376,6 +405,7 @@ public:
 
 private:
   Index::IdList &mIds;
+  QHash<git::Id,git::BloomFilter> &mFilters;
   QFile *mOut;
 };
 
@@ -420,10 +450,14 @@ public:
     int count = 0;
     QList<git::Commit> commits;
     git::Commit commit = mWalker.next();
-    QSet<git::Id> ids = QSet<git::Id>::fromList(mIndex.ids());
+    mIndexed = QSet<git::Id>::fromList(mIndex.ids());
+    QHash<git::Id,git::BloomFilter> filters =
+      mIndex.repo().changedPathFilters();
     while (commit.isValid() && count < 8192) {
       // Don't index merge commits.
-      if (!commit.isMerge() && !ids.contains(commit.id())) {
+      git::Id id = commit.id();
+      if (!commit.isMerge() &&
+          (!mIndexed.contains(id) || !filters.contains(id))) {
         commits.append(commit);
         ++count;
       }
@@ -441,7 +475,8 @@ public:
     using CommitList = QList<git::Commit>;
     mWatcher.setFuture(
       QtConcurrent::mappedReduced<Index::PostingMap,CommitList,Map,Reduce>(
-      commits, Map(mIndex.repo(), mLexers, mOut), Reduce(mIndex.ids(), mOut)));
+      commits, Map(mIndex.repo(), mLexers, mIndexed, mOut),
+      Reduce(mIndex.ids(), mFilters, mOut)));
     return true;
   }
 
@@ -458,6 +493,10 @@ public:
         QTextStream(stdout) << "write" << endl;
       log(mOut, "end write");
 
+      // Write changed path filters.
+      mIndex.repo().addChangedPathFilters(mFilters);
+      mFilters.clear();
+
       // Restart.
       start();
     }
@@ -491,6 +530,8 @@ private:
 
   git::RevWalk mWalker;
   LexerPool mLexers;
+  QSet<git::Id> mIndexed;
+  QHash<git::Id,git::BloomFilter> mFilters;
   QFutureWatcher<Index::PostingMap> mWatcher;
 };
 
@@ -134,32 +134,44 @@ bool BlameEditor::load(
   // Remember name.
   mName = name;
 
-  // Load content.
+  // Load content. Blobs and files are
+  // referenced in place rather than copied.
+  QFile file;
   QByteArray content;
   if (blob.isValid()) {
     if (blob.isBinary())
       return false;
 
-    content = blob.content();
+    content = blob.rawContent();
     mRevision = commit.isValid() ? commit.shortId() : tr("HEAD");
 
   } else {
     if (mRepo.isValid() && mRepo.index().isTracked(name))
       mRevision = tr("Working Copy");
 
-    QFile file(path());
+    file.setFileName(path());
     if (!file.open(QFile::ReadOnly))
       return false;
 
-    content = file.readAll();
+    qint64 size = file.size();
+    uchar *data = (size > 0 && size <= INT_MAX) ? file.map(0, size) : nullptr;
+    content = data ?
+      QByteArray::fromRawData(reinterpret_cast<char *>(data), size) :
+      file.readAll();
+
     git::Buffer buffer(content.constData(), content.length());
     if (buffer.isBinary())
       return false;
   }
 
-  // Set editor text.
+  // Set editor text. Skip decoding UTF-8.
   mEditor->setReadOnly(false);
-  mEditor->load(name, mRepo.isValid() ? mRepo.decode(content) : content);
+  if (mRepo.isValid() && !mRepo.isUtf8()) {
+    mEditor->load(name, mRepo.decode(content));
+  } else {
+    mEditor->load(name, content.constData(), content.length());
+  }
+
   mEditor->setReadOnly(blob.isValid());
 
   mMargin->setVisible(mRepo.isValid() && !content.isEmpty());
@@ -228,6 +240,9 @@ void BlameEditor::clear()
   mMargin->clear();
   mMargin->setVisible(false);
 
+  // Keep styles of the old text.
+  mEditor->cacheStyles();
+
   mEditor->setReadOnly(false);
   mEditor->clearAll();
   mEditor->setReadOnly(true);
@@ -20,12 +20,14 @@
 #include "git/Commit.h"
 #include "git/Config.h"
 #include "git/Diff.h"
+#include "git/Id.h"
 #include "git/Patch.h"
 #include "git/RevWalk.h"
 #include "git/Signature.h"
 #include "git/TagRef.h"
 #include "git/Tree.h"
 #include <QAbstractListModel>
+#include <QAtomicInt>
 #include <QApplication>
 #include <QMenu>
 #include <QPainter>
@@ -44,6 +46,15 @@
 
 namespace {
 
+const int kFetchCount = 64;
+const int kDateBucketSize = 1024;
+const int kPrefetchNeighbors = 3;
+
+// Show a status after this many back-to-back reruns and wait a bit
+// before running the rest of the plan.
+const int kMaxStatusReruns = 4;
+const int kStatusRerunDelay = 500;
+
 const int kStarPadding = 8;
 const int kLineSpacing = 16;
 const int kVerticalMargin = 2;
@@ -75,6 +86,30 @@ enum GraphSegment
   RightOut
 };
 
+// A sparse index from committer date to row. Each bucket covers
+// up to kDateBucketSize consecutive commits of the walk and records
+// the oldest committer date among them.
+struct DateBucket
+{
+  int row;
+  int count;
+  QDateTime date;
+};
+
+using DateIndex = QVector<DateBucket>;
+
+bool hasRenames(const git::Diff &diff)
+{
+  int count = diff.count();
+  for (int i = 0; i < count; ++i) {
+    git_delta_t status = diff.status(i);
+    if (status == GIT_DELTA_RENAMED || status == GIT_DELTA_COPIED)
+      return true;
+  }
+
+  return false;
+}
+
 class DiffCallbacks : public git::Diff::Callbacks
 {
 public:
@@ -107,23 +142,61 @@ public:
       emit dataChanged(idx, idx, {Qt::DisplayRole});
     });
 
+    // Run the plan that was held back to show the last status.
+    mStatusDelay.setSingleShot(true);
+    connect(&mStatusDelay, &QTimer::timeout, [this] {
+      if (mStatusPlanned && !mStatus.isRunning())
+        runStatus();
+    });
+
     // Connect watcher to signal when the status diff finishes.
     connect(&mStatus, &QFutureWatcher<git::Diff>::finished, [this] {
+      // Remember the result as the base of the next incremental update.
+      QFuture<git::Diff> future = mStatus.future();
+      if (future.resultCount()) {
+        mStatusBase = future.result();
+        mStatusBaseValid = true;
+      }
+
+      // Requests that arrived while running are already stale
+      // against this result. Run them before showing anything,
+      // unless a steady stream of changes keeps the status hidden.
+      if (mStatusPlanned && mStatusReruns < kMaxStatusReruns) {
+        ++mStatusReruns;
+        runStatus();
+        return;
+      }
+
+      mStatusReruns = 0;
       mTimer.stop();
-      resetWalker();
+      updateStatus();
       emit statusFinished(!mRows.isEmpty() && !mRows.first().commit.isValid());
+
+      if (mStatusPlanned)
+        mStatusDelay.start(kStatusRerunDelay);
     });
 
     git::RepositoryNotifier *notifier = repo.notifier();
     connect(notifier, &git::RepositoryNotifier::referenceUpdated,
             this, &CommitModel::resetReference);
-    connect(notifier, &git::RepositoryNotifier::workdirChanged, [this] {
-      resetReference(mRef);
+    connect(notifier, &git::RepositoryNotifier::workdirChanged,
+    [this](const QStringList &paths) {
+      // Only update the changed paths if they're known.
+      // No refs moved, so only the status row can change.
+      if (!mRef.isValid() || mRef.isHead())
+        startStatus(paths, paths.isEmpty());
     });
 
     resetSettings();
   }
 
+  ~CommitModel()
+  {
+    // The walk shares repository handles with this model.
+    cancelDateIndex();
+    mDateIndex.waitForFinished();
+  }
+
   git::Reference reference() const
   {
     return mRef;
@@ -141,22 +214,61 @@ public:
     return future.result();
   }
 
-  void startStatus()
+  // Update the status of the given paths relative to the last status.
+  // Paths whose index entries changed are always updated. Rescan the
+  // whole workdir if full is set or there's no last status. Only one
+  // status diff runs at a time. Requests that arrive in the meantime
+  // are merged into a single plan that runs when it finishes. The
+  // finished status is shown at least every few back-to-back runs.
+  void startStatus(const QStringList &paths = QStringList(), bool full = true)
   {
-    // Cancel existing status diff.
-    cancelStatus();
+    mStatusPlanned = true;
+    mStatusPlanFull = (mStatusPlanFull || full);
+    if (mStatusPlanFull) {
+      mStatusPlanPaths.clear();
+    } else {
+      foreach (const QString &path, paths)
+        mStatusPlanPaths.insert(path);
+    }
+
+    if (!mStatus.isRunning() && !mStatusDelay.isActive())
+      runStatus();
+  }
+
+  void runStatus()
+  {
+    bool full = (mStatusPlanFull || !mStatusBaseValid);
+    QStringList changed = full ? QStringList() : mStatusPlanPaths.toList();
+    git::Diff base = mStatusBase;
+
+    mStatusPlanned = false;
+    mStatusPlanFull = false;
+    mStatusPlanPaths.clear();
+    mStatusDelay.stop();
 
     // Check for uncommitted changes asynchronously.
-    mProgress = 0;
-    mTimer.start(50);
-    mStatus.setFuture(QtConcurrent::run([this] {
-      git::Diff status = mRepo.status(&mStatusCallbacks);
+    if (!mTimer.isActive()) {
+      mProgress = 0;
+      mTimer.start(50);
+    }
+
+    mStatus.setFuture(QtConcurrent::run([this, base, changed, full] {
+      git::Diff status = full ?
+        mRepo.status(&mStatusCallbacks) :
+        mRepo.status(base, changed, &mStatusCallbacks);
       return (status.isValid() && status.count()) ? status : git::Diff();
     }));
   }
 
   void cancelStatus()
   {
+    // Drop planned updates along with the running one.
+    mStatusPlanned = false;
+    mStatusPlanFull = false;
+    mStatusPlanPaths.clear();
+    mStatusDelay.stop();
+    mStatusReruns = 0;
+
     if (!mStatus.isRunning())
       return;
 
@@ -164,6 +276,9 @@ public:
     mStatus.waitForFinished();
     mStatus.setFuture(QFuture<git::Diff>());
     mStatusCallbacks.setCanceled(false);
+
+    // The last status misses the changes that were canceled.
+    mStatusBaseValid = false;
   }
 
   void setPathspec(const QString &pathspec)
@@ -188,9 +303,10 @@ public:
         ref.qualifiedName() == mRef.qualifiedName())
       mRef = ref;
 
-    // Status is invalid after HEAD changes.
+    // Status is invalid after HEAD changes. Files that were checked
+    // out show up as changed index entries.
     if (!ref.isValid() || ref.isHead())
-      startStatus();
+      startStatus(QStringList(), false);
 
     resetWalker();
   }
@@ -200,6 +316,7 @@ public:
     beginResetModel();
 
     // Reset state.
+    mIds.clear();
     mParents.clear();
     mRows.clear();
 
@@ -217,36 +334,13 @@ public:
     }
 
     // Begin walking commits.
-    if (mRef.isValid()) {
-      int sort = GIT_SORT_NONE;
-      if (mGraphVisible) {
-        sort |= GIT_SORT_TOPOLOGICAL;
-        if (mSortDate)
-          sort |= GIT_SORT_TIME;
-      } else if (!mSortDate) {
-        sort |= GIT_SORT_TOPOLOGICAL;
-      }
-
-      mWalker = mRef.walker(sort);
-      if (mRef.isLocalBranch()) {
-        // Add the upstream branch.
-        if (git::Branch upstream = git::Branch(mRef).upstream())
-          mWalker.push(upstream);
-      }
-
-      if (mRef.isHead()) {
-        // Add merge head.
-        if (git::Reference mergeHead = mRepo.lookupRef("MERGE_HEAD"))
-          mWalker.push(mergeHead);
-      }
+    int sort = sortFlags();
+    QList<git::Commit> tips = this->tips();
+    if (!tips.isEmpty())
+      mWalker = walker(sort, tips);
 
-      if (mRefsAll) {
-        foreach (const git::Reference ref, mRepo.refs()) {
-          if (!ref.isStash())
-            mWalker.push(ref);
-        }
-      }
-    }
+    // Index the same walk in the background.
+    startDateIndex(sort, tips);
 
     if (canFetchMore(QModelIndex()))
       fetchMore(QModelIndex());
@@ -254,6 +348,43 @@ public:
     endResetModel();
   }
 
+  // Update the status row without walking commits again. The existing
+  // rows only have to be rebuilt if the graph changes shape, i.e. when
+  // the status row comes or goes or is missing its graph segment.
+  void updateStatus()
+  {
+    bool head = (!mRef.isValid() || mRef.isHead());
+    bool valid = (mCleanStatus || !mStatus.isFinished() || status().isValid());
+    bool visible = (head && valid && mPathspec.isEmpty());
+    bool current = (!mRows.isEmpty() && !mRows.first().commit.isValid());
+    bool graph = (mGraphVisible && mRef.isValid());
+    if (visible == current) {
+      if (!current)
+        return;
+
+      if (!graph || mRows.first().columns.size() ||
+          !mStatus.isFinished()) {
+        QModelIndex idx = index(0, 0);
+        emit dataChanged(idx, idx);
+        return;
+      }
+    } else if (!graph) {
+      if (visible) {
+        beginInsertRows(QModelIndex(), 0, 0);
+        mRows.prepend(Row(git::Commit(), QVector<Column>()));
+        endInsertRows();
+      } else {
+        beginRemoveRows(QModelIndex(), 0, 0);
+        mRows.removeFirst();
+        endRemoveRows();
+      }
+
+      return;
+    }
+
+    resetWalker();
+  }
+
   void resetSettings(bool walk = false)
   {
     git::Config config = mRepo.appConfig();
@@ -273,11 +404,16 @@ public:
 
   void fetchMore(const QModelIndex &parent)
   {
-    // Load commits.
-    int i = 0;
+    fetch(kFetchCount);
+  }
+
+  // Load the next count commits in a single batch.
+  void fetch(int count)
+  {
+    // Pathspec matches are evaluated on multiple threads.
     QList<Row> rows;
-    git::Commit commit = mWalker.next(mPathspec);
-    while (commit.isValid()) {
+    QList<git::Commit> commits = mWalker.next(mPathspec, count);
+    foreach (const git::Commit &commit, commits) {
       // Add root commits.
       bool root = false;
       if (indexOf(commit) < 0) {
@@ -293,7 +429,7 @@ public:
       QList<git::Commit> replacements;
       foreach (const git::Commit &parent, commit.parents()) {
         // FIXME: Mark commits that point to existing parent?
-        if (indexOf(parent) < 0 && !contains(parent, rows))
+        if (indexOf(parent) < 0 && !mIds.contains(parent.id()))
           replacements.append(parent);
       }
 
@@ -315,12 +451,7 @@ public:
         row = columns(commit, parents, root);
 
       rows.append(Row(commit, row));
-
-      // Bail out.
-      if (i++ >= 64)
-        break;
-
-      commit = mWalker.next(mPathspec);
+      mIds.insert(commit.id());
     }
 
     // Update the model.
@@ -333,10 +464,43 @@ public:
     }
 
     // Invalidate walker.
-    if (!commit.isValid())
+    if (commits.size() < count)
       mWalker = git::RevWalk();
   }
 
+  // Load commits up to and including the given row in a single batch.
+  void fetchTo(int row)
+  {
+    if (row >= mRows.size() && canFetchMore(QModelIndex()))
+      fetch(row - mRows.size() + 1);
+  }
+
+  // Get the last row of the first bucket that contains a commit older
+  // than the given date. Return -1 if the date index isn't available.
+  int dateRow(const QDateTime &date) const
+  {
+    if (!mDateIndex.isFinished())
+      return -1;
+
+    QFuture<DateIndex> future = mDateIndex.future();
+    if (!future.resultCount())
+      return -1;
+
+    DateIndex index = future.result();
+    if (index.isEmpty())
+      return -1;
+
+    // Skip the status row.
+    int offset = (!mRows.isEmpty() && !mRows.first().commit.isValid());
+    foreach (const DateBucket &bucket, index) {
+      if (bucket.date < date)
+        return offset + bucket.row + bucket.count - 1;
+    }
+
+    const DateBucket &last = index.last();
+    return offset + last.row + last.count - 1;
+  }
+
   int rowCount(const QModelIndex &parent = QModelIndex()) const
   {
     return mRows.size();
@@ -375,14 +539,9 @@ public:
 
         return mStatus.isFinished() ? QVariant() : mProgress;
 
-      case DiffRole: {
-        if (status)
-          return QVariant::fromValue(this->status());
-
-        git::Diff diff = row.commit.diff();
-        diff.findSimilar();
-        return QVariant::fromValue(diff);
-      }
+      case DiffRole:
+        // Commit diffs come from the diff cache.
+        return status ? QVariant::fromValue(this->status()) : QVariant();
 
       case CommitRole:
         return status ? QVariant() : QVariant::fromValue(row.commit);
@@ -460,30 +619,175 @@ private:
     QVector<Column> columns;
   };
 
-  int indexOf(const git::Commit &commit) const
+  int sortFlags() const
   {
-    int count = mParents.size();
-    for (int i = 0; i < count; ++i) {
-      if (mParents.at(i).commit == commit)
-        return i;
+    int sort = GIT_SORT_NONE;
+    if (mGraphVisible) {
+      sort |= GIT_SORT_TOPOLOGICAL;
+      if (mSortDate)
+        sort |= GIT_SORT_TIME;
+    } else if (!mSortDate) {
+      sort |= GIT_SORT_TOPOLOGICAL;
     }
 
-    return -1;
+    return sort;
   }
 
-  bool contains(const git::Commit &commit, const QList<Row> &rows) const
+  // Get the commits that the walk starts from.
+  QList<git::Commit> tips() const
   {
-    foreach (const Row &row, mRows) {
-      if (row.commit == commit)
-        return true;
+    QList<git::Commit> tips;
+    if (!mRef.isValid())
+      return tips;
+
+    git::Commit target = mRef.target();
+    if (!target.isValid())
+      return tips;
+
+    tips.append(target);
+    if (mRef.isLocalBranch()) {
+      // Add the upstream branch.
+      if (git::Branch upstream = git::Branch(mRef).upstream()) {
+        if (git::Commit commit = upstream.target())
+          tips.append(commit);
+      }
     }
 
-    foreach (const Row &row, rows) {
-      if (row.commit == commit)
-        return true;
+    if (mRef.isHead()) {
+      // Add merge head.
+      if (git::Reference mergeHead = mRepo.lookupRef("MERGE_HEAD")) {
+        if (git::Commit commit = mergeHead.target())
+          tips.append(commit);
+      }
     }
 
-    return false;
+    if (mRefsAll) {
+      foreach (const git::Reference ref, mRepo.refs()) {
+        if (ref.isStash())
+          continue;
+
+        if (git::Commit commit = ref.target())
+          tips.append(commit);
+      }
+    }
+
+    return tips;
+  }
+
+  static git::RevWalk walker(int sort, const QList<git::Commit> &tips)
+  {
+    git::RevWalk walker = tips.first().walker(sort);
+    for (int i = 1; i < tips.size(); ++i)
+      walker.push(tips.at(i));
+    return walker;
+  }
+
+  void startDateIndex(int sort, const QList<git::Commit> &tips)
+  {
+    // The index depends only on the walk. Keep the
+    // existing index if the walk hasn't changed.
+    bool valid = (mPathspec.isEmpty() && !tips.isEmpty());
+    if (valid && sort == mDateIndexSort && tips == mDateIndexTips)
+      return;
+
+    // Try to extend a finished index of the same walk.
+    DateIndex base;
+    QList<git::Commit> baseTips;
+    if (valid && sort == mDateIndexSort && mDateIndex.isFinished()) {
+      QFuture<DateIndex> future = mDateIndex.future();
+      if (future.resultCount()) {
+        base = future.result();
+        baseTips = mDateIndexTips;
+      }
+    }
+
+    cancelDateIndex();
+    mDateIndex.setFuture(QFuture<DateIndex>());
+    mDateIndexTips.clear();
+    if (!valid)
+      return;
+
+    mDateIndexSort = sort;
+    mDateIndexTips = tips;
+
+    // Each walk gets its own flag so that cancellation doesn't block.
+    QSharedPointer<QAtomicInt> canceled(new QAtomicInt(0));
+    mDateIndexCanceled = canceled;
+
+    QList<git::Id> tipIds;
+    foreach (const git::Commit &tip, tips)
+      tipIds.append(tip.id());
+
+    QList<git::Id> baseIds;
+    foreach (const git::Commit &baseTip, baseTips)
+      baseIds.append(baseTip.id());
+
+    // Walk the history asynchronously on a separate handle.
+    git::Repository repo = mRepo;
+    mDateIndex.setFuture(QtConcurrent::run(
+    [repo, sort, tipIds, base, baseIds, canceled]() mutable {
+      // The previous walk is still valid if all of its tips are reachable.
+      // Only walk the new commits then. They are usually at the top. Rows
+      // of old commits are shifted by the number of new commits, which may
+      // overestimate their position but never underestimates it.
+      foreach (const git::Id &baseId, baseIds) {
+        bool reachable = false;
+        foreach (const git::Id &tipId, tipIds) {
+          if (tipId == baseId || repo.isDescendantOf(tipId, baseId)) {
+            reachable = true;
+            break;
+          }
+        }
+
+        if (!reachable) {
+          base.clear();
+          break;
+        }
+      }
+
+      int row = 0;
+      DateIndex index;
+      QList<git::Id> hidden = base.isEmpty() ? QList<git::Id>() : baseIds;
+      repo.walkDates(tipIds, hidden, sort, [&](const QDateTime &date) {
+        if (row % kDateBucketSize == 0) {
+          index.append({row, 0, date});
+        } else if (date < index.last().date) {
+          index.last().date = date;
+        }
+
+        ++index.last().count;
+        ++row;
+        return !canceled->load();
+      });
+
+      if (canceled->load())
+        return DateIndex();
+
+      foreach (DateBucket bucket, base) {
+        bucket.row += row;
+        index.append(bucket);
+      }
+
+      return index;
+    }));
+  }
+
+  // Cancel without waiting. A canceled walk yields an empty index.
+  void cancelDateIndex()
+  {
+    if (mDateIndexCanceled)
+      mDateIndexCanceled->store(1);
+  }
+
+  int indexOf(const git::Commit &commit) const
+  {
+    int count = mParents.size();
+    for (int i = 0; i < count; ++i) {
+      if (mParents.at(i).commit == commit)
+        return i;
+    }
+
+    return -1;
   }
 
   // The commit and parents parameters represent the current row.
@@ -584,6 +888,15 @@ private:
 
   DiffCallbacks mStatusCallbacks;
   QFutureWatcher<git::Diff> mStatus;
+  git::Diff mStatusBase;
+  bool mStatusBaseValid = false;
+
+  // The next status update.
+  bool mStatusPlanned = false;
+  bool mStatusPlanFull = false;
+  QSet<QString> mStatusPlanPaths;
+  QTimer mStatusDelay;
+  int mStatusReruns = 0;
 
   QString mPathspec;
   git::Reference mRef;
@@ -592,6 +905,13 @@ private:
 
   QList<Row> mRows;
   QList<Parent> mParents;
+  QSet<git::Id> mIds;
+
+  // date index
+  int mDateIndexSort = GIT_SORT_NONE;
+  QList<git::Commit> mDateIndexTips;
+  QSharedPointer<QAtomicInt> mDateIndexCanceled;
+  QFutureWatcher<DateIndex> mDateIndex;
 
   // walker settings
   bool mRefsAll = true;
@@ -624,12 +944,6 @@ public:
     int role = Qt::DisplayRole) const override
   {
     switch (role) {
-      case DiffRole: {
-        git::Diff diff = mCommits.at(index.row()).diff();
-        diff.findSimilar();
-        return QVariant::fromValue(diff);
-      }
-
       case CommitRole:
         return QVariant::fromValue(mCommits.at(index.row()));
     }
@@ -1042,7 +1356,7 @@ public:
 } // anon. namespace
 
 CommitList::CommitList(Index *index, QWidget *parent)
-  : QListView(parent), mIndex(index)
+  : QListView(parent), mIndex(index), mDiffs(index->repo())
 {
   Theme *theme = Application::theme();
   setPalette(theme->commitList());
@@ -1086,6 +1400,27 @@ CommitList::CommitList(Index *index, QWidget *parent)
     update(index);
   });
 
+  connect(&mDiff, &QFutureWatcher<git::Diff>::finished, [this] {
+    QFuture<git::Diff> future = mDiff.future();
+    if (!future.resultCount())
+      return;
+
+    git::Diff diff = future.result();
+    if (!diff.isValid())
+      return;
+
+    // Only replace the plain diff if renames were found.
+    if (!mDiffRenames || hasRenames(diff))
+      emit diffSelected(diff, mDiffFile, mDiffSpontaneous);
+
+    // Detect renames after the plain diff is shown.
+    git::Commit commit, base;
+    if (!mDiffRenames && selectedDiffRange(commit, base)) {
+      mDiffRenames = true;
+      mDiff.setFuture(mDiffs.request(commit, base));
+    }
+  });
+
   git::RepositoryNotifier *notifier = repo.notifier();
   connect(notifier, &git::RepositoryNotifier::referenceUpdated,
   [this](const git::Reference &ref) {
@@ -1135,17 +1470,15 @@ git::Diff CommitList::selectedDiff() const
   if (indexes.isEmpty())
     return git::Diff();
 
-  if (indexes.size() == 1)
-    return indexes.first().data(DiffRole).value<git::Diff>();
+  git::Commit commit, base;
+  if (!selectedDiffRange(commit, base)) {
+    if (indexes.size() == 1)
+      return indexes.first().data(DiffRole).value<git::Diff>();
 
-  git::Commit first = indexes.first().data(CommitRole).value<git::Commit>();
-  if (!first.isValid())
     return git::Diff();
+  }
 
-  git::Commit last = indexes.last().data(CommitRole).value<git::Commit>();
-  git::Diff diff = first.diff(last);
-  diff.findSimilar();
-  return diff;
+  return mDiffs.diff(commit, base);
 }
 
 QList<git::Commit> CommitList::selectedCommits() const
@@ -1274,6 +1607,33 @@ bool CommitList::selectRange(
   return true;
 }
 
+bool CommitList::selectDate(const QDateTime &date, bool spontaneous)
+{
+  // Load all candidate rows at once.
+  QAbstractItemModel *model = this->model();
+  if (model == mModel) {
+    CommitModel *commitModel = static_cast<CommitModel *>(mModel);
+    commitModel->fetchTo(commitModel->dateRow(date.addSecs(1)));
+  }
+
+  // Select the first commit at or before the given date.
+  for (int i = 0; i < model->rowCount(); ++i) {
+    QModelIndex index = model->index(i, 0);
+    if (git::Commit commit = index.data(CommitRole).value<git::Commit>()) {
+      if (commit.committer().date() <= date) {
+        selectIndexes(QItemSelection(index, index), QString(), spontaneous);
+        return true;
+      }
+    }
+
+    // Load more commits.
+    if (i == model->rowCount() - 1 && model->canFetchMore(QModelIndex()))
+      model->fetchMore(QModelIndex());
+  }
+
+  return false;
+}
+
 void CommitList::resetSettings()
 {
   static_cast<CommitModel *>(mModel)->resetSettings(true);
@@ -1569,8 +1929,14 @@ QModelIndex CommitList::findCommit(const git::Commit &commit)
     return !tmp.isValid() ? index : QModelIndex();
   }
 
-  // Find the id.
+  // Load all candidate rows at once.
   QDateTime date = commit.committer().date();
+  if (model == mModel) {
+    CommitModel *commitModel = static_cast<CommitModel *>(mModel);
+    commitModel->fetchTo(commitModel->dateRow(date));
+  }
+
+  // Find the id.
   for (int i = 0; i < model->rowCount(); ++i) {
     QModelIndex index = model->index(i, 0);
     if (git::Commit tmp = index.data(CommitRole).value<git::Commit>()) {
@@ -1618,7 +1984,77 @@ void CommitList::notifySelectionChanged()
   foreach (const QModelIndex &index, indexes)
     update(index);
 
-  emit diffSelected(selectedDiff(), mFile, mSpontaneous);
+  // Cancel pending diff.
+  mDiff.setFuture(QFuture<git::Diff>());
+  mDiffs.cancel();
+
+  // The status diff is already computed asynchronously.
+  git::Commit commit, base;
+  if (!selectedDiffRange(commit, base)) {
+    emit diffSelected(selectedDiff(), mFile, mSpontaneous);
+    return;
+  }
+
+  git::Diff diff = mDiffs.cached(commit, base);
+  if (diff.isValid()) {
+    emit diffSelected(diff, mFile, mSpontaneous);
+  } else {
+    // Compute the diff in the background and notify when it finishes.
+    // Show the diff without renames first if rename detection is slow.
+    // Otherwise, show the pending diff right away so that the previous
+    // selection's diff doesn't linger.
+    mDiffFile = mFile;
+    mDiffSpontaneous = mSpontaneous;
+    git::Diff plain = mDiffs.cached(commit, base, false);
+    mDiffRenames = plain.isValid();
+    mDiff.setFuture(mDiffs.request(commit, base, mDiffRenames));
+    emit diffSelected(
+      mDiffRenames ? plain : mDiffs.pending(), mFile, mSpontaneous);
+  }
+
+  // Speculatively compute diffs of the neighboring commits.
+  if (indexes.size() == 1)
+    prefetchNeighbors(indexes.first().row());
+}
+
+void CommitList::prefetchNeighbors(int row)
+{
+  // Alternate between the commits below and above,
+  // nearest first. Don't fetch more rows to find them.
+  QList<git::Commit> commits;
+  int rows = model()->rowCount();
+  for (int i = 1; i <= kPrefetchNeighbors; ++i) {
+    for (int neighbor : {row + i, row - i}) {
+      if (neighbor < 0 || neighbor >= rows)
+        continue;
+
+      QModelIndex index = model()->index(neighbor, 0);
+      git::Commit commit = index.data(CommitRole).value<git::Commit>();
+      if (commit.isValid())
+        commits.append(commit);
+    }
+  }
+
+  mDiffs.prefetch(commits);
+}
+
+bool CommitList::selectedDiffRange(
+  git::Commit &commit,
+  git::Commit &base) const
+{
+  QModelIndexList indexes = sortedIndexes();
+  if (indexes.isEmpty())
+    return false;
+
+  commit = indexes.first().data(CommitRole).value<git::Commit>();
+  if (!commit.isValid())
+    return false;
+
+  base = git::Commit();
+  if (indexes.size() > 1)
+    base = indexes.last().data(CommitRole).value<git::Commit>();
+
+  return true;
 }
 
 bool CommitList::isDecoration(const QModelIndex &index, const QPoint &pos)
@@ -10,10 +10,13 @@
 #ifndef COMMITLIST_H
 #define COMMITLIST_H
 
+#include "DiffCache.h"
 #include "git/Reference.h"
+#include <QFutureWatcher>
 #include <QListView>
 
 class Index;
+class QDateTime;
 
 namespace git {
 class Commit;
@@ -51,6 +54,9 @@ public:
     const QString &file = QString(),
     bool spontaneous = false);
 
+  // Select the first commit at or before the given date.
+  bool selectDate(const QDateTime &date, bool spontaneous = false);
+
   void resetSettings();
 
   void setModel(QAbstractItemModel *model) override;
@@ -83,6 +89,8 @@ private:
     bool spontaneous = false);
 
   void notifySelectionChanged();
+  bool selectedDiffRange(git::Commit &commit, git::Commit &base) const;
+  void prefetchNeighbors(int row);
 
   bool isDecoration(const QModelIndex &index, const QPoint &pos);
   bool isStar(const QModelIndex &index, const QPoint &pos);
@@ -99,6 +107,12 @@ private:
   QAbstractListModel *mModel;
 
   QString mSelectedRange;
+
+  DiffCache mDiffs;
+  QFutureWatcher<git::Diff> mDiff;
+  QString mDiffFile;
+  bool mDiffSpontaneous = true;
+  bool mDiffRenames = true;
 };
 
 #endif
@@ -453,6 +453,12 @@ public:
       updateButtons(yieldFocus);
     });
 
+    // Don't commit while files are staged in the background.
+    connect(repo.notifier(), &git::RepositoryNotifier::indexStagingChanged,
+    [this] {
+      updateButtons(false);
+    });
+
     QVBoxLayout *buttonLayout = new QVBoxLayout;
     buttonLayout->setContentsMargins(0,8,12,0);
     buttonLayout->addStretch();
@@ -468,9 +474,12 @@ public:
 
   void commit()
   {
+    RepoView *view = RepoView::parentView(this);
+    if (view->repo().isStaging())
+      return;
+
     // Check for a merge head.
     git::AnnotatedCommit upstream;
-    RepoView *view = RepoView::parentView(this);
     if (git::Reference mergeHead = view->repo().lookupRef("MERGE_HEAD"))
       upstream = mergeHead.annotatedCommit();
 
@@ -515,6 +524,7 @@ private:
     int staged = 0;
     int partial = 0;
     int conflicted = 0;
+    mIndex.prefetchStagedStates(mDiff);
     int count = mDiff.count();
     for (int i = 0; i < count; ++i) {
       QString name = mDiff.name(i);
@@ -575,7 +585,9 @@ private:
     int total = staged + partial + conflicted;
     mStage->setEnabled(count > staged);
     mUnstage->setEnabled(total);
-    mCommit->setEnabled(total && !mMessage->document()->isEmpty());
+    bool staging = RepoView::parentView(this)->repo().isStaging();
+    mCommit->setEnabled(
+      !staging && total && !mMessage->document()->isEmpty());
 
     // Set status text.
     QString status = tr("Nothing staged");
@@ -0,0 +1,249 @@
+//
+//          Copyright (c) 2016, Scientific Toolworks, Inc.
+//
+// This software is licensed under the MIT License. The LICENSE.md file
+// describes the conditions under which this software may be distributed.
+//
+// Author: Jason Haslam
+//
+
+#include "DiffCache.h"
+#include "git/Id.h"
+#include "git/Tree.h"
+#include <QAtomicInt>
+#include <QtConcurrent>
+
+namespace {
+
+// The cost of a diff is its estimated size in kilobytes:
+// a fixed size per delta plus its prefetched patches.
+const int kMaxCost = 64 * 1024;
+const qint64 kDeltaSize = 256;
+
+// Prefetch patches for the first files of each diff. Skip
+// diffs that are too large to be worth computing speculatively.
+const int kPrefetchPatches = 16;
+const int kPrefetchMaxDeltas = 2000;
+const qint64 kPrefetchMaxSize = 4 * 1024 * 1024;
+
+// Diffs are generated with default context and either with or
+// without rename detection. Bump these when that changes.
+const char kOptions = 'r';
+const char kPlainOptions = 'p';
+
+} // anon. namespace
+
+class DiffCache::Callbacks : public git::Diff::Callbacks
+{
+public:
+  Callbacks(bool stream = false)
+    : mPending(stream ? git::Diff::pending() : git::Diff())
+  {}
+
+  git::Diff pending() const
+  {
+    return mPending;
+  }
+
+  void cancel()
+  {
+    mCanceled = 1;
+  }
+
+  bool isCanceled() const
+  {
+    return mCanceled.load();
+  }
+
+  bool progress(const QString &oldPath, const QString &newPath) override
+  {
+    return !isCanceled();
+  }
+
+  void delta(const QString &name, git_delta_t status) override
+  {
+    if (mPending.isValid())
+      mPending.append(name, status);
+  }
+
+private:
+  git::Diff mPending;
+  QAtomicInt mCanceled = 0;
+};
+
+DiffCache::DiffCache(const git::Repository &repo)
+  : mRepo(repo), mCache(kMaxCost)
+{
+  mPrefetchPool.setMaxThreadCount(1);
+}
+
+DiffCache::~DiffCache()
+{
+  // Wait for requests that reference this cache.
+  cancel();
+  foreach (QFuture<git::Diff> future, mPending)
+    future.waitForFinished();
+
+  if (mPrefetchCallbacks)
+    mPrefetchCallbacks->cancel();
+  mPrefetchPool.waitForDone();
+}
+
+git::Diff DiffCache::cached(
+  const git::Commit &commit,
+  const git::Commit &base,
+  bool renames) const
+{
+  return cached(key(commit, base, renames));
+}
+
+git::Diff DiffCache::diff(
+  const git::Commit &commit,
+  const git::Commit &base,
+  bool renames) const
+{
+  QByteArray key = DiffCache::key(commit, base, renames);
+  git::Diff diff = cached(key);
+  if (diff.isValid())
+    return diff;
+
+  git::Id id = base.isValid() ? base.id() : git::Id();
+  return compute(commit.id(), id, key, renames, nullptr);
+}
+
+QFuture<git::Diff> DiffCache::request(
+  const git::Commit &commit,
+  const git::Commit &base,
+  bool renames)
+{
+  cancel();
+
+  // Forget finished requests.
+  QList<QFuture<git::Diff>>::iterator it = mPending.begin();
+  while (it != mPending.end())
+    it = it->isFinished() ? mPending.erase(it) : it + 1;
+
+  QSharedPointer<Callbacks> callbacks(new Callbacks(true));
+  mCallbacks = callbacks;
+
+  // Only pass ids to the worker.
+  git::Id id = commit.id();
+  git::Id baseId = base.isValid() ? base.id() : git::Id();
+  QByteArray key = DiffCache::key(commit, base, renames);
+  QFuture<git::Diff> future =
+    QtConcurrent::run([this, id, baseId, key, renames, callbacks] {
+      return compute(id, baseId, key, renames, callbacks.data());
+    });
+
+  mPending.append(future);
+  return future;
+}
+
+git::Diff DiffCache::pending() const
+{
+  return mCallbacks ? mCallbacks->pending() : git::Diff();
+}
+
+void DiffCache::cancel()
+{
+  if (mCallbacks)
+    mCallbacks->cancel();
+}
+
+void DiffCache::prefetch(const QList<git::Commit> &commits)
+{
+  if (mPrefetchCallbacks)
+    mPrefetchCallbacks->cancel();
+
+  // Skip commits that are already cached. Keys
+  // are computed here from the caller's objects.
+  QList<QPair<git::Id,QByteArray>> pending;
+  foreach (const git::Commit &commit, commits) {
+    QByteArray key = DiffCache::key(commit, git::Commit(), true);
+    if (!cached(key).isValid())
+      pending.append({commit.id(), key});
+  }
+
+  if (pending.isEmpty())
+    return;
+
+  QSharedPointer<Callbacks> callbacks(new Callbacks);
+  mPrefetchCallbacks = callbacks;
+
+  QtConcurrent::run(&mPrefetchPool, [this, pending, callbacks] {
+    QThread::currentThread()->setPriority(QThread::LowestPriority);
+    foreach (const auto &commit, pending) {
+      if (callbacks->isCanceled())
+        return;
+
+      // Another request may have computed it in the meantime.
+      if (!cached(commit.second).isValid()) {
+        compute(commit.first, git::Id(), commit.second,
+                true, callbacks.data(), true);
+      }
+    }
+  });
+}
+
+git::Diff DiffCache::cached(const QByteArray &key) const
+{
+  QMutexLocker locker(&mMutex);
+  git::Diff *diff = mCache.object(key);
+  return diff ? *diff : git::Diff();
+}
+
+git::Diff DiffCache::compute(
+  const git::Id &commit,
+  const git::Id &base,
+  const QByteArray &key,
+  bool renames,
+  Callbacks *callbacks,
+  bool patches) const
+{
+  git::Diff diff = mRepo.diffCommit(commit, base, -1, callbacks);
+  if (!diff.isValid())
+    return git::Diff();
+
+  // Don't spend time on huge diffs that may never be selected.
+  if (patches && diff.count() > kPrefetchMaxDeltas)
+    return git::Diff();
+
+  bool partial = false;
+  if (renames)
+    diff.findSimilar(mRepo, callbacks, &partial);
+
+  // Don't cache a diff with partial rename detection.
+  if (callbacks && callbacks->isCanceled())
+    return git::Diff();
+
+  // Show a diff that ran out of time, but try again next time.
+  if (partial)
+    return diff;
+
+  qint64 size = diff.count() * kDeltaSize;
+  if (patches)
+    size += diff.prefetchPatches(kPrefetchPatches, kPrefetchMaxSize);
+
+  QMutexLocker locker(&mMutex);
+  mCache.insert(key, new git::Diff(diff), qMax(1, int(size / 1024)));
+  return diff;
+}
+
+QByteArray DiffCache::key(
+  const git::Commit &commit,
+  const git::Commit &base,
+  bool renames)
+{
+  git::Tree old;
+  if (base.isValid()) {
+    old = base.tree();
+  } else {
+    QList<git::Commit> parents = commit.parents();
+    if (!parents.isEmpty())
+      old = parents.first().tree();
+  }
+
+  QByteArray key = old.isValid() ? old.id().toByteArray() : QByteArray();
+  QByteArray tree = commit.tree().id().toByteArray();
+  return key + tree + (renames ? kOptions : kPlainOptions);
+}
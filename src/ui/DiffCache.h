@@ -0,0 +1,99 @@
+//
+//          Copyright (c) 2016, Scientific Toolworks, Inc.
+//
+// This software is licensed under the MIT License. The LICENSE.md file
+// describes the conditions under which this software may be distributed.
+//
+// Author: Jason Haslam
+//
+
+#ifndef DIFFCACHE_H
+#define DIFFCACHE_H
+
+#include "git/Commit.h"
+#include "git/Diff.h"
+#include "git/Repository.h"
+#include <QCache>
+#include <QFuture>
+#include <QMutex>
+#include <QSharedPointer>
+#include <QThreadPool>
+
+// An LRU cache of commit diffs keyed by the trees and options that
+// they were generated from. Diffs include rename detection unless
+// renames is false. Rename detection can be much slower than the diff
+// itself, so callers can show the plain diff first. Diffs are computed
+// either on the calling thread or asynchronously. Asynchronous diffs
+// can be shown as pending diffs while they're generated. Diffs of
+// commits that are likely to be selected next can be prefetched at
+// low priority. Workers only see commit ids and look them up on
+// separate repository handles.
+class DiffCache
+{
+public:
+  DiffCache(const git::Repository &repo);
+  ~DiffCache();
+
+  // Get the cached diff of commit against base, or against its first
+  // parent if base is invalid. Return an invalid diff on cache miss.
+  git::Diff cached(
+    const git::Commit &commit,
+    const git::Commit &base = git::Commit(),
+    bool renames = true) const;
+
+  // Compute the diff on the calling thread if it isn't cached.
+  git::Diff diff(
+    const git::Commit &commit,
+    const git::Commit &base = git::Commit(),
+    bool renames = true) const;
+
+  // Compute the diff on a worker thread. Starting a new request
+  // cancels the previous one. A canceled request yields an invalid
+  // diff. Cancellation doesn't block.
+  QFuture<git::Diff> request(
+    const git::Commit &commit,
+    const git::Commit &base = git::Commit(),
+    bool renames = true);
+
+  // Get a pending diff that lists the files of the current request
+  // as they are found. It doesn't change after the request finishes.
+  git::Diff pending() const;
+
+  void cancel();
+
+  // Compute the diffs of the given commits against their first parent
+  // and generate their first few patches on a low priority thread.
+  // Starting a new prefetch cancels the previous one.
+  void prefetch(const QList<git::Commit> &commits);
+
+private:
+  class Callbacks;
+
+  git::Diff cached(const QByteArray &key) const;
+
+  git::Diff compute(
+    const git::Id &commit,
+    const git::Id &base,
+    const QByteArray &key,
+    bool renames,
+    Callbacks *callbacks,
+    bool patches = false) const;
+
+  static QByteArray key(
+    const git::Commit &commit,
+    const git::Commit &base,
+    bool renames);
+
+  git::Repository mRepo;
+
+  mutable QMutex mMutex;
+  mutable QCache<QByteArray,git::Diff> mCache;
+
+  QList<QFuture<git::Diff>> mPending;
+  QSharedPointer<Callbacks> mCallbacks;
+
+  QThreadPool mPrefetchPool;
+  QSharedPointer<Callbacks> mPrefetchCallbacks;
+};
+
+#endif
@@ -14,6 +14,7 @@
 #include "FileContextMenu.h"
 #include "MenuBar.h"
 #include "RepoView.h"
+#include "WordDiff.h"
 #include "app/Application.h"
 #include "conf/Settings.h"
 #include "git/Blame.h"
@@ -53,16 +54,34 @@
 #include <QTableWidget>
 #include <QTextEdit>
 #include <QTextLayout>
+#include <QTextCodec>
 #include <QTextStream>
 #include <QToolButton>
 #include <QVBoxLayout>
+#include <QtConcurrent>
 #include <QtMath>
+#include <algorithm>
 
 namespace {
 
 const int kIndent = 2;
+const int kFileSpacing = 4;
+
+// Rough heights used to lay out files that aren't loaded.
+const int kFileHeight = 32;
+const int kHunkHeight = 30;
+const int kHunkLines = 8;
+const int kLineBytes = 32;
+const int kMaxEstimateLines = 100000;
+
+const int kEstimateBatch = 64;
+const int kLoadPasses = 4;
+const int kUnloadPages = 4;
 const int kArrowWidth = 20;
 const int kArrowMargin = 6;
+
+// Untracked files are only searched up to this size.
+const qint64 kMaxFindSize = 4 * 1024 * 1024;
 const QString kHunkFmt = "<h4>%1</h4>";
 
 const QString kStyleSheet =
@@ -234,6 +253,135 @@ private:
   QByteArray mNewLine;
 };
 
+// The content of a hunk editor. It's prepared on a worker thread
+// so that the GUI thread only has to copy it into the editor.
+struct HunkContent
+{
+  QString text;
+  QList<Line> lines;
+  QByteArrayList margins;
+  QVector<int> markers;
+  int width = 0;
+  int conflictWidth = 0;
+  WordDiff::Result words;
+};
+
+HunkContent prepareHunk(
+  const git::Patch &patch,
+  int index,
+  QTextCodec *codec,
+  const WordDiff &words)
+{
+  HunkContent hunk;
+  QList<Line> &lines = hunk.lines;
+
+  // Read lines.
+  QByteArray content;
+  git::Patch::Hunk patchHunk = patch.hunk(index);
+  content.reserve(patchHunk.content.size() + patchHunk.lines.size());
+  foreach (const git::Patch::Line &line, patchHunk.lines) {
+    char origin = line.origin;
+    if (origin == GIT_DIFF_LINE_CONTEXT_EOFNL ||
+        origin == GIT_DIFF_LINE_ADD_EOFNL ||
+        origin == GIT_DIFF_LINE_DEL_EOFNL) {
+      Q_ASSERT(!lines.isEmpty());
+      lines.last().setNewline(false);
+      content += '\n';
+      continue;
+    }
+
+    lines << Line(origin, line.oldLine, line.newLine);
+    content.append(patchHunk.content.constData() + line.offset, line.length);
+  }
+
+  // Trim final line end.
+  if (content.endsWith('\n'))
+    content.chop(1);
+  if (content.endsWith('\r'))
+    content.chop(1);
+
+  hunk.text = codec->toUnicode(content);
+
+  // Calculate margin width.
+  foreach (const Line &line, lines) {
+    int oldWidth = line.oldLine().length();
+    int newWidth = line.newLine().length();
+    hunk.width = qMax(hunk.width, oldWidth + newWidth + 1);
+    hunk.conflictWidth = qMax(hunk.conflictWidth, oldWidth);
+  }
+
+  // Format line numbers and find markers and matching lines.
+  int additions = 0;
+  int deletions = 0;
+  int count = lines.size();
+  for (int lidx = 0; lidx < count; ++lidx) {
+    const Line &line = lines.at(lidx);
+    QByteArray oldLine = line.oldLine();
+    QByteArray newLine = line.newLine();
+    int spaces = hunk.width - (oldLine.length() + newLine.length());
+    hunk.margins.append(oldLine + QByteArray(spaces, ' ') + newLine);
+
+    int marker = -1;
+    switch (line.origin()) {
+      case GIT_DIFF_LINE_CONTEXT:
+        marker = TextEditor::Context;
+        additions = 0;
+        deletions = 0;
+        break;
+
+      case GIT_DIFF_LINE_ADDITION:
+        marker = TextEditor::Addition;
+        ++additions;
+        if (lidx + 1 >= count ||
+            lines.at(lidx + 1).origin() != GIT_DIFF_LINE_ADDITION) {
+          // The heuristic is that matching blocks have
+          // the same number of additions as deletions.
+          if (additions == deletions) {
+            for (int i = 0; i < additions; ++i) {
+              int current = lidx - i;
+              int match = current - additions;
+              lines[current].setMatchingLine(match);
+              lines[match].setMatchingLine(current);
+            }
+          }
+
+          additions = 0;
+          deletions = 0;
+        }
+        break;
+
+      case GIT_DIFF_LINE_DELETION:
+        marker = TextEditor::Deletion;
+        ++deletions;
+        break;
+
+      case 'O':
+        marker = TextEditor::Ours;
+        break;
+
+      case 'T':
+        marker = TextEditor::Theirs;
+        break;
+    }
+
+    hunk.markers.append(marker);
+  }
+
+  // Diff matching lines.
+  QList<QPair<int,int>> pairs;
+  for (int lidx = 0; lidx < count; ++lidx) {
+    const Line &line = lines.at(lidx);
+    int matchingLine = line.matchingLine();
+    if (line.origin() == GIT_DIFF_LINE_DELETION && matchingLine >= 0)
+      pairs.append({lidx, matchingLine});
+  }
+
+  if (!pairs.isEmpty())
+    hunk.words = words.diff(hunk.text.toUtf8(), pairs);
+
+  return hunk;
+}
+
 class Button : public QToolButton
 {
 public:
@@ -802,6 +950,13 @@ public:
     if (index >= 0)
       mEditor->setLineCount(patch.lineCount(index));
 
+    // Start preparing content. Repaint when it's ready.
+    if (index >= 0) {
+      connect(&mWatcher, &QFutureWatcherBase::finished,
+              this, QOverload<>::of(&HunkWidget::update));
+      prepare();
+    }
+
     connect(mEditor, &TextEditor::updateUi,
             MenuBar::instance(this), &MenuBar::updateCutCopyPaste);
 
@@ -1043,80 +1198,37 @@ public:
 protected:
   void paintEvent(QPaintEvent *event) override
   {
-    load();
+    // Show a placeholder until the content is ready.
+    load(false);
     QFrame::paintEvent(event);
   }
 
 private:
-  struct Token
-  {
-    int pos;
-    QByteArray text;
-  };
-
-  int tokenEndPosition(int pos) const
-  {
-    int length = mEditor->length();
-    char ch = mEditor->charAt(pos);
-    QByteArray wordChars = mEditor->wordChars();
-    if (wordChars.contains(ch)) {
-      do {
-        ch = mEditor->charAt(++pos);
-      } while (pos < length && wordChars.contains(ch));
-      return pos;
-    }
-
-    QByteArray spaceChars = mEditor->whitespaceChars();
-    if (spaceChars.contains(ch)) {
-      do {
-        ch = mEditor->charAt(++pos);
-      } while (pos < length && spaceChars.contains(ch));
-      return pos;
-    }
-
-    return pos + 1;
-  }
-
-  QList<Token> tokens(int line) const
-  {
-    QList<Token> tokens;
-
-    int end = mEditor->lineEndPosition(line);
-    int pos = mEditor->positionFromLine(line);
-    while (pos < end) {
-      int wordEnd = tokenEndPosition(pos);
-      tokens.append({pos, mEditor->textRange(pos, wordEnd)});
-      pos = wordEnd;
-    }
-
-    // Add sentinel.
-    tokens.append({pos, ""});
-
-    return tokens;
-  }
-
-  QByteArray tokenBuffer(const QList<Token> &tokens)
-  {
-    QByteArrayList list;
-    foreach (const Token &token, tokens)
-      list.append(token.text);
-    return list.join('\n');
-  }
-
-  void load()
+  void load(bool wait = true)
   {
     if (mLoaded)
       return;
 
-    mLoaded = true;
-
     // Load entire file.
     git::Repository repo = mPatch.repo();
     if (mIndex < 0) {
+      mLoaded = true;
       QString name = mPatch.name();
       QFile dev(repo.workdir().filePath(name));
       if (dev.open(QFile::ReadOnly)) {
-        mEditor->load(name, repo.decode(dev.readAll()));
+        // Map the file instead of reading a copy of it.
+        qint64 size = dev.size();
+        bool map = (size > 0 && size <= INT_MAX);
+        uchar *data = map ? dev.map(0, size) : nullptr;
+        QByteArray content = data ?
+          QByteArray::fromRawData(reinterpret_cast<char *>(data), size) :
+          dev.readAll();
+
+        if (repo.isUtf8()) {
+          mEditor->load(name, content.constData(), content.length());
+        } else {
+          mEditor->load(name, repo.decode(content));
+        }
 
         int count = mEditor->lineCount();
         QByteArray lines = QByteArray::number(count);
@@ -1131,60 +1243,29 @@ private:
       return;
     }
 
-    // Load hunk.
-    QList<Line> lines;
-    QByteArray content;
-    int patchCount = mPatch.lineCount(mIndex);
-    for (int lidx = 0; lidx < patchCount; ++lidx) {
-      char origin = mPatch.lineOrigin(mIndex, lidx);
-      if (origin == GIT_DIFF_LINE_CONTEXT_EOFNL ||
-          origin == GIT_DIFF_LINE_ADD_EOFNL ||
-          origin == GIT_DIFF_LINE_DEL_EOFNL) {
-        Q_ASSERT(!lines.isEmpty());
-        lines.last().setNewline(false);
-        content += '\n';
-        continue;
-      }
+    // Wait for the hunk to be prepared in the background.
+    if (!mContent.isFinished()) {
+      if (!wait)
+        return;
 
-      int oldLine = mPatch.lineNumber(mIndex, lidx, git::Diff::OldFile);
-      int newLine = mPatch.lineNumber(mIndex, lidx, git::Diff::NewFile);
-      lines << Line(origin, oldLine, newLine);
-      content += mPatch.lineContent(mIndex, lidx);
+      mContent.waitForFinished();
     }
 
-    // Trim final line end.
-    if (content.endsWith('\n'))
-      content.chop(1);
-    if (content.endsWith('\r'))
-      content.chop(1);
+    mLoaded = true;
 
     // Add text.
-    mEditor->setText(repo.decode(content));
-
-    // Calculate margin width.
-    int width = 0;
-    int conflictWidth = 0;
-    foreach (const Line &line, lines) {
-      int oldWidth = line.oldLine().length();
-      int newWidth = line.newLine().length();
-      width = qMax(width, oldWidth + newWidth + 1);
-      conflictWidth = qMax(conflictWidth, oldWidth);
-    }
+    HunkContent hunk = mContent.result();
+    mEditor->setText(hunk.text);
+    mEditor->restoreStyles();
 
     // Get comments for this file.
     Account::FileComments comments = mView->comments().files.value(mPatch.name());
 
     // Add markers and line numbers.
-    int additions = 0;
-    int deletions = 0;
-    int count = lines.size();
+    int count = hunk.lines.size();
     for (int lidx = 0; lidx < count; ++lidx) {
-      const Line &line = lines.at(lidx);
-      QByteArray oldLine = line.oldLine();
-      QByteArray newLine = line.newLine();
-      int spaces = width - (oldLine.length() + newLine.length());
-      QByteArray text = oldLine + QByteArray(spaces, ' ') + newLine;
-      mEditor->marginSetText(lidx, text);
+      const Line &line = hunk.lines.at(lidx);
+      mEditor->marginSetText(lidx, hunk.margins.at(lidx));
       mEditor->marginSetStyle(lidx, STYLE_LINENUMBER);
 
       // Build annotations.
@@ -1261,107 +1342,24 @@ private:
         mEditor->annotationSetVisible(ANNOTATION_STANDARD);
       }
 
-      // Find matching lines.
-      int marker = -1;
-      switch (line.origin()) {
-        case GIT_DIFF_LINE_CONTEXT:
-          marker = TextEditor::Context;
-          additions = 0;
-          deletions = 0;
-          break;
-
-        case GIT_DIFF_LINE_ADDITION:
-          marker = TextEditor::Addition;
-          ++additions;
-          if (lidx + 1 >= count ||
-              mPatch.lineOrigin(mIndex, lidx + 1) != GIT_DIFF_LINE_ADDITION) {
-            // The heuristic is that matching blocks have
-            // the same number of additions as deletions.
-            if (additions == deletions) {
-              for (int i = 0; i < additions; ++i) {
-                int current = lidx - i;
-                int match = current - additions;
-                lines[current].setMatchingLine(match);
-                lines[match].setMatchingLine(current);
-              }
-            }
-
-            additions = 0;
-            deletions = 0;
-          }
-          break;
-
-        case GIT_DIFF_LINE_DELETION:
-          marker = TextEditor::Deletion;
-          ++deletions;
-          break;
-
-        case 'O':
-          marker = TextEditor::Ours;
-          break;
-
-        case 'T':
-          marker = TextEditor::Theirs;
-          break;
-      }
-
       // Add marker.
+      int marker = hunk.markers.at(lidx);
       if (marker >= 0)
         mEditor->markerAdd(lidx, marker);
     }
 
-    // Diff matching lines.
-    for (int lidx = 0; lidx < count; ++lidx) {
-      const Line &line = lines.at(lidx);
-      int matchingLine = line.matchingLine();
-      if (line.origin() == GIT_DIFF_LINE_DELETION && matchingLine >= 0) {
-        // Split lines into tokens and diff corresponding tokens.
-        QList<Token> oldTokens = tokens(lidx);
-        QList<Token> newTokens = tokens(matchingLine);
-        QByteArray oldBuffer = tokenBuffer(oldTokens);
-        QByteArray newBuffer = tokenBuffer(newTokens);
-        git::Patch patch = git::Patch::fromBuffers(oldBuffer, newBuffer);
-        for (int pidx = 0; pidx < patch.count(); ++pidx) {
-          // Find the boundary between additions and deletions.
-          int index;
-          int count = patch.lineCount(pidx);
-          for (index = 0; index < count; ++index) {
-            if (patch.lineOrigin(pidx, index) == GIT_DIFF_LINE_ADDITION)
-              break;
-          }
-
-          // Map differences onto the deletion line.
-          if (index > 0) {
-            int first = patch.lineNumber(pidx, 0, git::Diff::OldFile) - 1;
-            int last = patch.lineNumber(pidx, index - 1, git::Diff::OldFile);
+    // Highlight changed words.
+    mEditor->setIndicatorCurrent(TextEditor::WordDeletion);
+    foreach (const WordDiff::Range &range, hunk.words.deletions)
+      mEditor->indicatorFillRange(range.pos, range.length);
 
-            int size = oldTokens.size();
-            if (first >= 0 && first < size && last >= 0 && last < size) {
-              int pos = oldTokens.at(first).pos;
-              mEditor->setIndicatorCurrent(TextEditor::WordDeletion);
-              mEditor->indicatorFillRange(pos, oldTokens.at(last).pos - pos);
-            }
-          }
-
-          // Map differences onto the addition line.
-          if (index < count) {
-            int first = patch.lineNumber(pidx, index, git::Diff::NewFile) - 1;
-            int last = patch.lineNumber(pidx, count - 1, git::Diff::NewFile);
-
-            int size = newTokens.size();
-            if (first >= 0 && first < size && last >= 0 && last < size) {
-              int pos = newTokens.at(first).pos;
-              mEditor->setIndicatorCurrent(TextEditor::WordAddition);
-              mEditor->indicatorFillRange(pos, newTokens.at(last).pos - pos);
-            }
-          }
-        }
-      }
-    }
+    mEditor->setIndicatorCurrent(TextEditor::WordAddition);
+    foreach (const WordDiff::Range &range, hunk.words.additions)
+      mEditor->indicatorFillRange(range.pos, range.length);
 
     // Set margin width.
-    QByteArray text(mPatch.isConflicted() ? conflictWidth : width, ' ');
-    int margin = mEditor->textWidth(STYLE_DEFAULT, text);
+    int width = mPatch.isConflicted() ? hunk.conflictWidth : hunk.width;
+    int margin = mEditor->textWidth(STYLE_DEFAULT, QByteArray(width, ' '));
     if (margin > mEditor->marginWidthN(TextEditor::LineNumbers))
       mEditor->setMarginWidthN(TextEditor::LineNumbers, margin);
 
@@ -1393,6 +1391,19 @@ private:
     mEditor->updateGeometry();
   }
 
+  void prepare()
+  {
+    git::Patch patch = mPatch;
+    int index = mIndex;
+    QTextCodec *codec = patch.repo().codec();
+    WordDiff words(mEditor->wordChars(), mEditor->whitespaceChars());
+    mContent = QtConcurrent::run([patch, index, codec, words] {
+      return prepareHunk(patch, index, codec, words);
+    });
+
+    mWatcher.setFuture(mContent);
+  }
+
   void chooseLines(TextEditor::Marker kind)
   {
     // Edit hunk.
@@ -1416,6 +1427,9 @@ private:
   Header *mHeader;
   TextEditor *mEditor;
   bool mLoaded = false;
+
+  QFuture<HunkContent> mContent;
+  QFutureWatcher<HunkContent> mWatcher;
 };
 
 class LineStats : public QWidget
@@ -2000,12 +2014,13 @@ public:
       return;
     }
 
-    QByteArray buffer = mPatch.apply(hunks);
-    if (buffer.isEmpty())
+    size_t size = 0;
+    git::Id id = mPatch.applyToOdb(hunks, &size);
+    if (id.isNull() || !size)
       return;
 
-    // Add the buffer to the index.
-    mIndex.add(mPatch.name(), buffer);
+    // Add the blob to the index.
+    mIndex.add(mPatch.name(), id, size);
   }
 
 signals:
@@ -2034,6 +2049,26 @@ DiffView::DiffView(const git::Repository &repo, QWidget *parent)
 
   mPlugins = Plugin::plugins(repo);
 
+  // Refine height estimates when idle.
+  mEstimateTimer.setInterval(0);
+  connect(&mEstimateTimer, &QTimer::timeout, this, &DiffView::estimateHeights);
+
+  // Lay out again after file widgets change size.
+  mLayoutTimer.setSingleShot(true);
+  mLayoutTimer.setInterval(0);
+  connect(&mLayoutTimer, &QTimer::timeout, [this] {
+    layoutFiles();
+    updateFiles();
+  });
+
+  // Create and destroy file widgets on scroll.
+  connect(verticalScrollBar(), &QScrollBar::valueChanged,
+          this, &DiffView::updateFiles);
+
+  // Diff only the files that changed in the index.
+  connect(repo.notifier(), &git::RepositoryNotifier::indexChanged,
+          this, &DiffView::updateStagedPatches);
+
   // Update comments.
   if (Repository *remote = RepoView::parentView(this)->remoteRepo()) {
     connect(remote->account(), &Account::commentsReady, this, [this, remote](
@@ -2051,25 +2086,51 @@ DiffView::DiffView(const git::Repository &repo, QWidget *parent)
 
       mComments = comments;
 
-      // Invalidate editors.
-      foreach (QWidget *widget, mFiles) {
-        foreach (HunkWidget *hunk, static_cast<FileWidget *>(widget)->hunks())
+      // Invalidate editors. Unloaded files pick up comments when loaded.
+      foreach (const File &file, mFiles) {
+        if (!file.widget)
+          continue;
+
+        FileWidget *widget = static_cast<FileWidget *>(file.widget);
+        foreach (HunkWidget *hunk, widget->hunks())
           hunk->invalidate();
       }
 
       // Load commit comments.
-      if (!canFetchMore())
-        fetchMore();
+      delete mCommentWidget;
+      mCommentWidget = nullptr;
+      if (!mFiles.isEmpty() && !mComments.comments.isEmpty()) {
+        mCommentWidget = new CommentWidget(mComments.comments, widget());
+        mCommentWidget->show();
+      }
+
+      layoutFiles();
     });
   }
 }
 
 DiffView::~DiffView() {}
 
-QWidget *DiffView::file(int index)
+int DiffView::fileAt(int y) const
 {
-  fetchAll(index);
-  return mFiles.at(index);
+  // Find the last file that starts at or above y.
+  auto it = std::upper_bound(mFiles.begin(), mFiles.end(), y,
+  [](int y, const File &file) {
+    return y < file.y;
+  });
+
+  while (it != mFiles.begin()) {
+    if ((--it)->visible)
+      return it - mFiles.begin();
+  }
+
+  // Fall back to the first visible file.
+  for (int i = 0; i < mFiles.size(); ++i) {
+    if (mFiles.at(i).visible)
+      return i;
+  }
+
+  return -1;
 }
 
 void DiffView::setDiff(const git::Diff &diff, const git::Index &index)
@@ -2077,15 +2138,18 @@ void DiffView::setDiff(const git::Diff &diff, const git::Index &index)
   RepoView *view = RepoView::parentView(this);
   git::Repository repo = view->repo();
 
-  // Disconnect signals.
-  foreach (QMetaObject::Connection connection, mConnections)
-    disconnect(connection);
-  mConnections.clear();
-
   // Clear state.
   mFiles.clear();
+  mStagedDiff = git::Diff();
+  mStagedTree = git::Tree();
   mStagedPatches.clear();
   mComments = Account::CommitComments();
+  mCommentWidget = nullptr;
+  mMatchText = QString();
+  mMatchCount = 0;
+  mMatches.clear();
+  mMatchHunks.clear();
+  mEstimateTimer.stop();
 
   // Set data.
   mDiff = diff;
@@ -2099,11 +2163,6 @@ void DiffView::setDiff(const git::Diff &diff, const git::Index &index)
   // This allows drawing content over the border shadow.
   widget->setStyleSheet(".QWidget {background-color: transparent}");
 
-  // Begin layout.
-  QVBoxLayout *layout = new QVBoxLayout(widget);
-  layout->setSpacing(4);
-  layout->setSizeConstraint(QLayout::SetMinAndMaxSize);
-
   if (!diff.isValid()) {
     if (repo.isHeadUnborn()) {
       QPushButton *button =
@@ -2129,6 +2188,7 @@ void DiffView::setDiff(const git::Diff &diff, const git::Index &index)
       labelFont.setPointSize(18);
       label->setFont(labelFont);
 
+      QVBoxLayout *layout = new QVBoxLayout(widget);
       layout->addStretch();
       layout->addWidget(button, 0, Qt::AlignHCenter);
       layout->addWidget(label, 0, Qt::AlignHCenter);
@@ -2138,35 +2198,34 @@ void DiffView::setDiff(const git::Diff &diff, const git::Index &index)
     return;
   }
 
+  // Patches aren't available until the diff is complete.
+  if (diff.isPending())
+    return;
+
   // Generate a diff between the head tree and index.
   if (index.isValid()) {
     if (git::Reference head = repo.head()) {
       if (git::Commit commit = head.target()) {
-        git::Diff stagedDiff = repo.diffTreeToIndex(commit.tree());
-        for (int i = 0; i < stagedDiff.count(); ++i)
-          mStagedPatches[stagedDiff.name(i)] = stagedDiff.patch(i);
+        mStagedTree = commit.tree();
+        mStagedDiff = repo.diffTreeToIndex(mStagedTree);
       }
     }
   }
 
-  if (canFetchMore())
-    fetchMore();
+  // Start with a rough estimate for every file. Files
+  // near the viewport are measured when they're loaded.
+  int count = diff.count();
+  int lineHeight = fontMetrics().lineSpacing();
+  mFiles.resize(count);
+  for (int i = 0; i < count; ++i)
+    mFiles[i].height = kFileHeight + kHunkHeight + kHunkLines * lineHeight;
 
-  // Load patches on demand.
-  QScrollBar *scrollBar = verticalScrollBar();
-  mConnections.append(
-    connect(scrollBar, &QScrollBar::valueChanged, [this](int value) {
-      if (value > verticalScrollBar()->maximum() / 2 && canFetchMore())
-        fetchMore();
-    })
-  );
-
-  mConnections.append(
-    connect(scrollBar, &QScrollBar::rangeChanged, [this](int min, int max) {
-      if (max - min < this->widget()->height() / 2 && canFetchMore())
-        fetchMore();
-    })
-  );
+  layoutFiles();
+  updateFiles();
+
+  // Refine the remaining estimates in the background.
+  mEstimated = 0;
+  mEstimateTimer.start();
 
   // Request comments for this diff.
   if (Repository *remoteRepo = view->remoteRepo()) {
@@ -2180,43 +2239,109 @@ void DiffView::setDiff(const git::Diff &diff, const git::Index &index)
 
 bool DiffView::scrollToFile(int index)
 {
-  // Ensure that the given index is loaded.
-  fetchAll(index);
-
-  // Finish layout by processing events. May cause a new diff to
-  // be loaded. In that case the scroll widget will be different.
-  QWidget *ptr = widget();
-  QCoreApplication::processEvents();
-  if (widget() != ptr)
+  if (index < 0 || index >= mFiles.size())
+    return false;
+
+  // Load the file to get its real height.
+  if (!loadFile(index))
     return false;
 
-  // Scroll to the widget.
-  verticalScrollBar()->setValue(mFiles.at(index)->y());
+  layoutFiles();
+  verticalScrollBar()->setValue(mFiles.at(index).y);
+  updateFiles();
   return true;
 }
 
 void DiffView::setFilter(const QStringList &paths)
 {
-  fetchAll();
   QSet<QString> set = QSet<QString>::fromList(paths);
-  foreach (QWidget *widget, mFiles) {
-    FileWidget *file = static_cast<FileWidget *>(widget);
-    file->setVisible(set.isEmpty() || set.contains(file->name()));
+  for (int i = 0; i < mFiles.size(); ++i) {
+    File &file = mFiles[i];
+    file.visible = (set.isEmpty() || set.contains(mDiff.name(i)));
+    if (file.widget)
+      file.widget->setVisible(file.visible);
   }
+
+  // Search visible files again.
+  mMatchText = QString();
+
+  layoutFiles();
+  updateFiles();
 }
 
 QList<TextEditor *> DiffView::editors()
 {
-  fetchAll();
   QList<TextEditor *> editors;
-  foreach (QWidget *widget, mFiles) {
-    foreach (HunkWidget *hunk, static_cast<FileWidget *>(widget)->hunks())
+  foreach (const File &file, mFiles) {
+    if (!file.widget)
+      continue;
+
+    FileWidget *widget = static_cast<FileWidget *>(file.widget);
+    foreach (HunkWidget *hunk, widget->hunks())
       editors.append(hunk->editor());
   }
 
   return editors;
 }
 
+int DiffView::editorCount(const QString &text)
+{
+  if (text.isEmpty())
+    return editors().size();
+
+  findMatches(text);
+  return mMatchHunks.size();
+}
+
+TextEditor *DiffView::editor(const QString &text, int index)
+{
+  if (text.isEmpty())
+    return editors().value(index);
+
+  // Load the file when the search reaches it.
+  findMatches(text);
+  if (index < 0 || index >= mMatchHunks.size())
+    return nullptr;
+
+  const QPair<int,int> &match = mMatchHunks.at(index);
+  bool loaded = mFiles.at(match.first).widget;
+  FileWidget *file = static_cast<FileWidget *>(loadFile(match.first));
+  if (!file)
+    return nullptr;
+
+  if (!loaded)
+    layoutFiles();
+
+  QList<HunkWidget *> hunks = file->hunks();
+  return (match.second < hunks.size()) ?
+    hunks.at(match.second)->editor() : nullptr;
+}
+
+int DiffView::highlightAll(const QString &text)
+{
+  if (text.isEmpty())
+    return EditorProvider::highlightAll(text);
+
+  // Files that aren't loaded are highlighted when they are.
+  findMatches(text);
+  for (int i = 0; i < mFiles.size(); ++i) {
+    if (!mFiles.at(i).widget)
+      continue;
+
+    FileWidget *file = static_cast<FileWidget *>(mFiles.at(i).widget);
+    QList<HunkWidget *> hunks = file->hunks();
+    foreach (HunkWidget *hunk, hunks)
+      hunk->editor()->clearHighlights();
+
+    foreach (int match, mMatches.at(i)) {
+      if (match < hunks.size())
+        hunks.at(match)->editor()->highlightAll(text);
+    }
+  }
+
+  return mMatchCount;
+}
+
 void DiffView::ensureVisible(TextEditor *editor, int pos)
 {
   HunkWidget *hunk = static_cast<HunkWidget *>(editor->parentWidget());
@@ -2238,6 +2363,27 @@ void DiffView::ensureVisible(TextEditor *editor, int pos)
   }
 }
 
+void DiffView::setHighlight(const QString &text)
+{
+  mHighlight = text;
+}
+
+bool DiffView::eventFilter(QObject *obj, QEvent *event)
+{
+  // Measure file widgets again after their layout changes.
+  if (event->type() == QEvent::LayoutRequest)
+    mLayoutTimer.start();
+
+  return QScrollArea::eventFilter(obj, event);
+}
+
+void DiffView::resizeEvent(QResizeEvent *event)
+{
+  QScrollArea::resizeEvent(event);
+  layoutFiles();
+  updateFiles();
+}
+
 void DiffView::dropEvent(QDropEvent *event)
 {
   if (event->dropAction() != Qt::CopyAction)
@@ -2263,59 +2409,305 @@ void DiffView::dragEnterEvent(QDragEnterEvent *event)
     event->acceptProposedAction();
 }
 
-bool DiffView::canFetchMore()
+QWidget *DiffView::loadFile(int index)
 {
-  return (mDiff.isValid() && mFiles.size() < mDiff.count());
+  File &file = mFiles[index];
+  if (file.widget)
+    return file.widget;
+
+  git::Patch patch = mDiff.patch(index);
+  if (!patch.isValid()) {
+    // This diff is stale. Refresh the view.
+    RepoView *view = RepoView::parentView(this);
+    QTimer::singleShot(0, view, &RepoView::refresh);
+    return nullptr;
+  }
+
+  git::Patch staged = stagedPatch(patch.name());
+  FileWidget *widget =
+    new FileWidget(this, patch, staged, mIndex, this->widget());
+
+  DisclosureButton *button = widget->header()->disclosureButton();
+  if (widget->isEmpty()) {
+    button->setChecked(false);
+    button->setEnabled(false);
+  } else if (file.expanded >= 0) {
+    // Restore the state from before the widget was unloaded.
+    button->setChecked(file.expanded);
+  }
+
+  connect(button, &DisclosureButton::toggled, this,
+  [this, index](bool checked) {
+    mFiles[index].expanded = checked;
+  });
+
+  // Respond to diagnostic signal.
+  connect(widget, &FileWidget::diagnosticAdded,
+          this, &DiffView::diagnosticAdded);
+
+  // Restore find highlights.
+  if (!mHighlight.isEmpty()) {
+    int count = 0;
+    QList<HunkWidget *> hunks = widget->hunks();
+    QList<int> matches = (mHighlight == mMatchText) ?
+      mMatches.at(index) : findHunks(index, mHighlight, count);
+    foreach (int match, matches) {
+      if (match < hunks.size())
+        hunks.at(match)->editor()->highlightAll(mHighlight);
+    }
+  }
+
+  widget->installEventFilter(this);
+  widget->setVisible(file.visible);
+
+  file.widget = widget;
+  return widget;
 }
 
-void DiffView::fetchMore()
+void DiffView::unloadFile(int index)
 {
-  QVBoxLayout *layout = static_cast<QVBoxLayout *>(widget()->layout());
+  File &file = mFiles[index];
+  if (!file.widget)
+    return;
 
-  // Add widgets.
-  int init = mFiles.size();
-  int patchCount = mDiff.count();
-  RepoView *view = RepoView::parentView(this);
-  for (int pidx = init; pidx < patchCount && pidx - init < 8; ++pidx) {
-    git::Patch patch = mDiff.patch(pidx);
-    if (!patch.isValid()) {
-      // This diff is stale. Refresh the view.
-      QTimer::singleShot(0, view, &RepoView::refresh);
-      return;
+  // Defer deletion. The widget may be on the stack.
+  file.widget->removeEventFilter(this);
+  file.widget->hide();
+  file.widget->deleteLater();
+  file.widget = nullptr;
+}
+
+int DiffView::estimateHeight(int index) const
+{
+  // Generating patches is too slow for large diffs. Estimate
+  // the number of lines from the file sizes instead.
+  int lineHeight = fontMetrics().lineSpacing();
+  int rough = kFileHeight + kHunkHeight + kHunkLines * lineHeight;
+  if (mDiff.isBinary(index))
+    return kFileHeight;
+
+  git::Repository repo = RepoView::parentView(this)->repo();
+  qint64 oldSize = mDiff.size(index, git::Diff::OldFile, repo);
+  qint64 newSize = mDiff.size(index, git::Diff::NewFile, repo);
+  if (oldSize < 0 || newSize < 0)
+    return rough;
+
+  // Added and deleted files show every line. Otherwise
+  // assume that the difference in size is one more hunk.
+  int height = rough;
+  qint64 size = qAbs(newSize - oldSize);
+  git_delta_t status = mDiff.status(index);
+  if (status == GIT_DELTA_ADDED || status == GIT_DELTA_UNTRACKED) {
+    height = kFileHeight + kHunkHeight;
+    size = newSize;
+  } else if (status == GIT_DELTA_DELETED) {
+    height = kFileHeight + kHunkHeight;
+    size = oldSize;
+  }
+
+  qint64 lines = qMin<qint64>(size / kLineBytes, kMaxEstimateLines);
+  return height + lines * lineHeight;
+}
+
+void DiffView::estimateHeights()
+{
+  // Estimate a batch of files at a time.
+  int end = qMin(mEstimated + kEstimateBatch, mFiles.size());
+  for (; mEstimated < end; ++mEstimated) {
+    File &file = mFiles[mEstimated];
+    if (!file.widget)
+      file.height = estimateHeight(mEstimated);
+  }
+
+  if (mEstimated >= mFiles.size())
+    mEstimateTimer.stop();
+
+  layoutFiles();
+}
+
+void DiffView::layoutFiles()
+{
+  if (mFiles.isEmpty())
+    return;
+
+  // Keep the file at the top of the viewport in place.
+  QScrollBar *scrollBar = verticalScrollBar();
+  int value = scrollBar->value();
+  int anchor = fileAt(value);
+  int offset = (anchor >= 0) ? value - mFiles.at(anchor).y : 0;
+
+  QStyle *style = this->style();
+  int left = style->pixelMetric(QStyle::PM_LayoutLeftMargin);
+  int top = style->pixelMetric(QStyle::PM_LayoutTopMargin);
+  int right = style->pixelMetric(QStyle::PM_LayoutRightMargin);
+  int bottom = style->pixelMetric(QStyle::PM_LayoutBottomMargin);
+  int width = viewport()->width() - left - right;
+
+  int y = top;
+  for (int i = 0; i < mFiles.size(); ++i) {
+    File &file = mFiles[i];
+    file.y = y;
+    if (!file.visible)
+      continue;
+
+    if (QWidget *widget = file.widget) {
+      file.height = widget->hasHeightForWidth() ?
+        widget->heightForWidth(width) : widget->sizeHint().height();
+      widget->setGeometry(left, y, width, file.height);
     }
 
-    git::Patch staged = mStagedPatches.value(patch.name());
-    FileWidget *file = new FileWidget(this, patch, staged, mIndex, widget());
-    layout->addWidget(file);
+    y += file.height + kFileSpacing;
+  }
+
+  if (mCommentWidget) {
+    int height = mCommentWidget->sizeHint().height();
+    mCommentWidget->setGeometry(left, y, width, height);
+    y += height;
+  }
 
-    mFiles.append(file);
+  widget()->setMinimumHeight(y + bottom);
 
-    if (file->isEmpty()) {
-      DisclosureButton *button = file->header()->disclosureButton();
-      button->setChecked(false);
-      button->setEnabled(false);
+  if (anchor >= 0)
+    scrollBar->setValue(mFiles.at(anchor).y + offset);
+}
+
+void DiffView::updateFiles()
+{
+  // Laying out files can scroll and call back into this function.
+  if (mFiles.isEmpty() || mUpdating)
+    return;
+
+  mUpdating = true;
+
+  // Load files within a page of the viewport. Loading replaces
+  // estimates with real heights, so repeat until nothing changes.
+  QScrollBar *scrollBar = verticalScrollBar();
+  int page = viewport()->height();
+  for (int pass = 0; pass < kLoadPasses; ++pass) {
+    int min = scrollBar->value() - page;
+    int max = scrollBar->value() + 2 * page;
+
+    bool loaded = false;
+    for (int i = qMax(fileAt(min), 0); i < mFiles.size(); ++i) {
+      const File &file = mFiles.at(i);
+      if (file.y > max)
+        break;
+
+      if (file.visible && !file.widget && loadFile(i))
+        loaded = true;
     }
 
-    // Respond to diagnostic signal.
-    connect(file, &FileWidget::diagnosticAdded,
-            this, &DiffView::diagnosticAdded);
+    if (!loaded)
+      break;
+
+    layoutFiles();
   }
 
-  // Finish layout.
-  if (mFiles.size() == mDiff.count()) {
-    // Add comments widget.
-    if (!mComments.comments.isEmpty())
-      layout->addWidget(new CommentWidget(mComments.comments, widget()));
+  // Unload files that are far away from the viewport.
+  QWidget *focus = QApplication::focusWidget();
+  int min = scrollBar->value() - kUnloadPages * page;
+  int max = scrollBar->value() + (kUnloadPages + 1) * page;
+  for (int i = 0; i < mFiles.size(); ++i) {
+    const File &file = mFiles.at(i);
+    if (file.widget && (file.y + file.height < min || file.y > max) &&
+        !file.widget->isAncestorOf(focus))
+      unloadFile(i);
+  }
 
-    layout->addStretch();
+  mUpdating = false;
+}
+
+git::Patch DiffView::stagedPatch(const QString &name) const
+{
+  auto it = mStagedPatches.constFind(name);
+  if (it != mStagedPatches.constEnd())
+    return it.value();
+
+  int index = mStagedDiff.isValid() ? mStagedDiff.indexOf(name) : -1;
+  return (index >= 0) ? mStagedDiff.patch(index) : git::Patch();
+}
+
+void DiffView::updateStagedPatches(const QStringList &paths)
+{
+  if (!mStagedDiff.isValid())
+    return;
+
+  git::Repository repo = RepoView::parentView(this)->repo();
+  git::Diff diff = repo.diffTreeToIndex(mStagedTree, paths);
+  if (!diff.isValid())
+    return;
+
+  foreach (const QString &path, paths)
+    mStagedPatches[path] = git::Patch();
+
+  for (int i = 0; i < diff.count(); ++i)
+    mStagedPatches[diff.name(i)] = diff.patch(i);
+}
+
+void DiffView::findMatches(const QString &text)
+{
+  if (text == mMatchText)
+    return;
+
+  // Search patch content instead of loading every file.
+  mMatchText = text;
+  mMatchCount = 0;
+  mMatches.clear();
+  mMatches.resize(mFiles.size());
+  mMatchHunks.clear();
+  for (int i = 0; i < mFiles.size(); ++i) {
+    if (!mFiles.at(i).visible)
+      continue;
+
+    int count = 0;
+    mMatches[i] = findHunks(i, text, count);
+    foreach (int hunk, mMatches.at(i))
+      mMatchHunks.append({i, hunk});
+    mMatchCount += count;
   }
 }
 
-void DiffView::fetchAll(int index)
+QList<int> DiffView::findHunks(
+  int index,
+  const QString &text,
+  int &count) const
 {
-  // Load all patches up to and including index.
-  while ((index < 0 || mFiles.size() <= index) && canFetchMore())
-    fetchMore();
+  QList<int> hunks;
+  git::Patch patch = mDiff.patch(index);
+  if (!patch.isValid() || patch.isBinary())
+    return hunks;
+
+  // Untracked files are shown as a single hunk. Don't read huge files.
+  git::Repository repo = patch.repo();
+  if (patch.isUntracked()) {
+    QFile dev(repo.workdir().filePath(patch.name()));
+    if (dev.open(QFile::ReadOnly)) {
+      QByteArray content = dev.read(kMaxFindSize);
+      int matches = repo.decode(content).count(text, Qt::CaseInsensitive);
+      if (matches) {
+        hunks.append(0);
+        count += matches;
+      }
+    }
+
+    return hunks;
+  }
+
+  int hunkCount = patch.count();
+  for (int i = 0; i < hunkCount; ++i) {
+    QByteArray content;
+    int lineCount = patch.lineCount(i);
+    for (int j = 0; j < lineCount; ++j)
+      content += patch.lineContent(i, j);
+
+    int matches = repo.decode(content).count(text, Qt::CaseInsensitive);
+    if (matches) {
+      hunks.append(i);
+      count += matches;
+    }
+  }
+
+  return hunks;
 }
 
 #include "DiffView.moc"
@@ -15,10 +15,13 @@
 #include "git/Commit.h"
 #include "git/Diff.h"
 #include "git/Index.h"
+#include "git/Tree.h"
 #include "host/Account.h"
 #include "plugins/Plugin.h"
 #include <QMap>
 #include <QScrollArea>
+#include <QTimer>
+#include <QVector>
 
 class QCheckBox;
 class QVBoxLayout;
@@ -31,7 +34,9 @@ public:
   DiffView(const git::Repository &repo, QWidget *parent = nullptr);
   virtual ~DiffView();
 
-  QWidget *file(int index);
+  // Get the index of the file at the given y position
+  // in widget coordinates. Return -1 if there isn't one.
+  int fileAt(int y) const;
 
   void setDiff(const git::Diff &diff, const git::Index &index);
 
@@ -42,26 +47,74 @@ public:
   const Account::CommitComments &comments() const { return mComments; }
 
   QList<TextEditor *> editors() override;
+  int editorCount(const QString &text) override;
+  TextEditor *editor(const QString &text, int index) override;
+  int highlightAll(const QString &text) override;
   void ensureVisible(TextEditor *editor, int pos) override;
+  void setHighlight(const QString &text) override;
 
 signals:
   void diagnosticAdded(TextEditor::DiagnosticKind kind);
 
 protected:
+  bool eventFilter(QObject *obj, QEvent *event) override;
+  void resizeEvent(QResizeEvent *event) override;
   void dropEvent(QDropEvent *event) override;
   void dragEnterEvent(QDragEnterEvent *event) override;
 
 private:
-  bool canFetchMore();
-  void fetchMore();
-  void fetchAll(int index = -1);
+  // Only files near the viewport have a widget. The others
+  // are represented by their position and estimated height.
+  struct File
+  {
+    int y = 0;
+    int height = 0;
+    int expanded = -1;
+    bool visible = true;
+    QWidget *widget = nullptr;
+  };
+
+  QWidget *loadFile(int index);
+  void unloadFile(int index);
+
+  int estimateHeight(int index) const;
+  void estimateHeights();
+
+  void layoutFiles();
+  void updateFiles();
+
+  // Find the hunks of visible files that contain text. Matches
+  // are cached until the text, diff or filter changes.
+  void findMatches(const QString &text);
+  QList<int> findHunks(int index, const QString &text, int &count) const;
+
+  // Get the patch of a file between the head tree and index.
+  git::Patch stagedPatch(const QString &name) const;
+  void updateStagedPatches(const QStringList &paths);
 
   git::Diff mDiff;
   git::Index mIndex;
+
+  // Staged patches are generated on demand from the staged diff.
+  // Files that changed in the index since then are diffed again.
+  git::Diff mStagedDiff;
+  git::Tree mStagedTree;
   QMap<QString,git::Patch> mStagedPatches;
 
-  QList<QWidget *> mFiles;
-  QList<QMetaObject::Connection> mConnections;
+  QVector<File> mFiles;
+  QWidget *mCommentWidget = nullptr;
+
+  bool mUpdating = false;
+
+  int mEstimated = 0;
+  QTimer mEstimateTimer;
+  QTimer mLayoutTimer;
+
+  QString mHighlight;
+  QString mMatchText;
+  int mMatchCount = 0;
+  QVector<QList<int>> mMatches;
+  QList<QPair<int,int>> mMatchHunks;
 
   QList<PluginRef> mPlugins;
   Account::CommitComments mComments;
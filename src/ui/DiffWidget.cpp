@@ -158,28 +158,11 @@ void DiffWidget::selectFile(const QString &file)
 
 void DiffWidget::setCurrentFile(int value)
 {
-  // FIXME: This is bogus.
-  if (!mDiffView->widget())
+  int row = mDiffView->fileAt(value);
+  if (row < 0)
     return;
 
-  QAbstractItemModel *model = mFiles->model();
-  int rows = model->rowCount();
-  for (int i = 0; i < rows; ++i) {
-    if (!mDiffView->file(i)->isVisible())
-      continue;
-
-    // Get the position of the next widget.
-    int pos = mDiffView->widget()->height();
-    if (i < rows - 1)
-      pos = mDiffView->file(i + 1)->y();
-
-    // Stop at the first index where the scroll
-    // value is less than the next widget.
-    if (value < pos) {
-      QModelIndex index = model->index(i, 0);
-      mFiles->selectionModel()->select(index, kSelectionFlags);
-      mFiles->scrollTo(index);
-      break;
-    }
-  }
+  QModelIndex index = mFiles->model()->index(row, 0);
+  mFiles->selectionModel()->select(index, kSelectionFlags);
+  mFiles->scrollTo(index);
 }
@@ -24,12 +24,16 @@
 #include <QPainter>
 #include <QSettings>
 #include <QStyledItemDelegate>
+#include <QTimer>
 #include <QWindow>
 
 namespace {
 
 const QString kFileRowsKey = "file/rows";
 
+// Poll pending diffs for new files at this interval.
+const int kPendingInterval = 100; // ms
+
 class FileModel : public QAbstractListModel
 {
   Q_OBJECT
@@ -40,6 +44,9 @@ public:
   {
     connect(repo.notifier(), &git::RepositoryNotifier::indexChanged,
             this, &FileModel::updateCheckState);
+
+    mPendingTimer.setInterval(kPendingInterval);
+    connect(&mPendingTimer, &QTimer::timeout, this, &FileModel::fetchPending);
   }
 
   void setDiff(const git::Diff &diff, const git::Index &index)
@@ -47,12 +54,22 @@ public:
     beginResetModel();
     mDiff = diff;
     mIndex = index;
+    mRows = diff.isValid() ? diff.count() : 0;
+    if (index.isValid())
+      index.prefetchStagedStates(diff);
     endResetModel();
+
+    // Add files of a pending diff in chunks as they're found.
+    if (diff.isPending()) {
+      mPendingTimer.start();
+    } else {
+      mPendingTimer.stop();
+    }
   }
 
   int rowCount(const QModelIndex &parent = QModelIndex()) const override
   {
-    return mDiff.isValid() ? mDiff.count() : 0;
+    return mRows;
   }
 
   QVariant data(
@@ -121,6 +138,17 @@ public:
   }
 
 private:
+  void fetchPending()
+  {
+    int count = mDiff.count();
+    if (count <= mRows)
+      return;
+
+    beginInsertRows(QModelIndex(), mRows, count - 1);
+    mRows = count;
+    endInsertRows();
+  }
+
   void updateCheckState(const QStringList &paths)
   {
     foreach (const QString &path, paths) {
@@ -135,6 +163,9 @@ private:
   git::Diff mDiff;
   git::Index mIndex;
   bool mYieldFocus = true;
+
+  int mRows = 0;
+  QTimer mPendingTimer;
 };
 
 class FileDelegate : public QStyledItemDelegate
@@ -223,6 +254,10 @@ FileList::FileList(const git::Repository &repo, QWidget *parent)
   setSelectionMode(QAbstractItemView::ExtendedSelection);
 
   setModel(new FileModel(repo, this));
+
+  // Grow with pending diffs.
+  connect(model(), &QAbstractItemModel::rowsInserted,
+          this, &FileList::updateHeight);
   setItemDelegate(new FileDelegate(this));
 
   mButton = new ContextMenuButton(this);
@@ -294,13 +329,7 @@ void FileList::setDiff(
   model->setDiff(diff, index);
 
   int rows = model->rowCount();
-  setVisible(rows > 0);
-  if (rows > 0) {
-    int rowHeight = sizeHintForRow(0);
-    setMinimumHeight(rowHeight + 1);
-    setMaximumHeight(rowHeight * rows + 1);
-  }
-
+  updateHeight();
   updateMenu(diff);
 
   if (pathspec.isEmpty())
@@ -316,6 +345,17 @@ void FileList::setDiff(
   selectionModel()->select(selection, QItemSelectionModel::ClearAndSelect);
 }
 
+void FileList::updateHeight()
+{
+  int rows = model()->rowCount();
+  setVisible(rows > 0);
+  if (rows > 0) {
+    int rowHeight = sizeHintForRow(0);
+    setMinimumHeight(rowHeight + 1);
+    setMaximumHeight(rowHeight * rows + 1);
+  }
+}
+
 QSize FileList::sizeHint() const
 {
   QSettings settings;
@@ -50,6 +50,7 @@ protected:
   void resizeEvent(QResizeEvent *) override;
 
 private:
+  void updateHeight();
   void updateMenu(const git::Diff &diff);
 
   QAction *mSortName;
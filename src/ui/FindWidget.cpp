@@ -145,6 +145,24 @@ FindWidget::FindWidget(EditorProvider *provider, QWidget *parent)
   connect(done, &QToolButton::clicked, this, &FindWidget::hide);
 }
 
+int EditorProvider::editorCount(const QString &text)
+{
+  return editors().size();
+}
+
+TextEditor *EditorProvider::editor(const QString &text, int index)
+{
+  return editors().value(index);
+}
+
+int EditorProvider::highlightAll(const QString &text)
+{
+  int matches = 0;
+  foreach (TextEditor *editor, editors())
+    matches += editor->highlightAll(text);
+  return matches;
+}
+
 void FindWidget::reset()
 {
   mEditorIndex = 0;
@@ -152,15 +170,15 @@ void FindWidget::reset()
 
 void FindWidget::clearHighlights()
 {
+  mEditorProvider->setHighlight(QString());
   foreach (TextEditor *editor, mEditorProvider->editors())
     editor->clearHighlights();
 }
 
 void FindWidget::highlightAll()
 {
-  int matches = 0;
-  foreach (TextEditor *editor, mEditorProvider->editors())
-    matches += editor->highlightAll(sText);
+  mEditorProvider->setHighlight(sText);
+  int matches = mEditorProvider->highlightAll(sText);
 
   QString text;
   switch (matches) {
@@ -190,11 +208,20 @@ void FindWidget::find(Direction direction)
 {
   bool forward = (direction != Backward);
 
-  // Search through all editors until a match is found.
-  // Then search the initial editor again from the beginning.
-  QList<TextEditor *> editors = mEditorProvider->editors();
-  for (int i = 0; i < editors.size() + 1; ++i) {
-    TextEditor *editor = editors.at(mEditorIndex);
+  // Search through all editors until a match is found. Then search
+  // the initial editor again from the beginning. Editors are only
+  // requested as the search reaches them.
+  int count = mEditorProvider->editorCount(sText);
+  if (!count)
+    return;
+
+  if (mEditorIndex >= count)
+    mEditorIndex = 0;
+
+  for (int i = 0; i < count + 1; ++i) {
+    TextEditor *editor = mEditorProvider->editor(sText, mEditorIndex);
+    if (!editor)
+      return;
 
     // Advance to end of selection.
     if (direction == Advance) {
@@ -213,19 +240,22 @@ void FindWidget::find(Direction direction)
     // Choose next index.
     if (forward) {
       ++mEditorIndex;
-      if (mEditorIndex > editors.size() - 1)
+      if (mEditorIndex > count - 1)
         mEditorIndex = 0;
     } else {
       --mEditorIndex;
       if (mEditorIndex < 0)
-        mEditorIndex = editors.size() - 1;
+        mEditorIndex = count - 1;
     }
 
     // Reset current editor selection.
     editor->setSelection(0, 0);
 
     // Reset next editor selection.
-    TextEditor *next = editors.at(mEditorIndex);
+    TextEditor *next = mEditorProvider->editor(sText, mEditorIndex);
+    if (!next)
+      return;
+
     int extreme = forward ? 0 : next->length();
     next->setSelection(extreme, extreme);
   }
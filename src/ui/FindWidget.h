@@ -22,6 +22,17 @@ class EditorProvider
 public:
   virtual QList<TextEditor *> editors() = 0;
   virtual void ensureVisible(TextEditor *editor, int pos) = 0;
+
+  // Providers that create editors on demand can override these to
+  // create an editor only when the search reaches it, to count matches
+  // without creating editors and to highlight the search text in
+  // editors created later. Editors that don't contain the search text
+  // can be left out.
+  virtual int editorCount(const QString &text);
+  virtual TextEditor *editor(const QString &text, int index);
+  virtual int highlightAll(const QString &text);
+
+  virtual void setHighlight(const QString &text) {}
 };
 
 class FindWidget : public QWidget
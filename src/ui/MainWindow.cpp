@@ -29,6 +29,7 @@
 #include <QSettings>
 #include <QTimeLine>
 #include <QToolButton>
+#include <QtConcurrent>
 
 namespace {
 
@@ -58,6 +59,15 @@ MainWindow::MainWindow(
   setUnifiedTitleAndToolBarOnMac(true);
   setAcceptDrops(true);
 
+  // Update again when ahead/behind counts become available. That
+  // also starts the most recent request that came in while running.
+  connect(&mAheadBehind, &QFutureWatcher<bool>::finished, this, [this] {
+    bool pending = mAheadBehindPending;
+    mAheadBehindPending = false;
+    if (mAheadBehind.result() || pending)
+      updateInterface();
+  });
+
   // Create new menu bar for this window if there isn't a shared one.
   MenuBar *menuBar = MenuBar::instance(this);
 
@@ -444,20 +454,51 @@ void MainWindow::updateInterface()
 
   int ahead = 0;
   int behind = 0;
+  bool known = true;
   if (RepoView *view = currentView()) {
-    if (git::Branch head = view->repo().head()) {
+    git::Repository repo = view->repo();
+    if (git::Branch head = repo.head()) {
       if (git::Branch upstream = head.upstream()) {
-        ahead = head.difference(upstream);
-        behind = upstream.difference(head);
+        git::Commit local = head.target();
+        git::Commit remote = upstream.target();
+        if (!repo.cachedAheadBehind(local, remote, ahead, behind)) {
+          known = false;
+          startAheadBehind(repo, local, remote);
+        }
       }
     }
   }
 
+  // Unknown counts are passed as -1.
+  if (!known) {
+    ahead = -1;
+    behind = -1;
+  }
+
   updateTouchBar(ahead, behind);
   updateWindowTitle(ahead, behind);
   mToolBar->updateButtons(ahead, behind);
 }
 
+void MainWindow::startAheadBehind(
+  const git::Repository &repo,
+  const git::Commit &local,
+  const git::Commit &upstream)
+{
+  // The walk can't be interrupted. Remember that the current
+  // commits changed and request them again when it finishes.
+  if (mAheadBehind.isRunning()) {
+    mAheadBehindPending = true;
+    return;
+  }
+
+  mAheadBehind.setFuture(QtConcurrent::run([repo, local, upstream] {
+    int ahead = 0;
+    int behind = 0;
+    return repo.aheadBehind(local, upstream, ahead, behind);
+  }));
+}
+
 void MainWindow::updateWindowTitle(int ahead, int behind)
 {
   RepoView *view = currentView();
@@ -476,19 +517,28 @@ void MainWindow::updateWindowTitle(int ahead, int behind)
   // Add remote tracking information.
   if (git::Branch branch = head) {
     if (git::Branch upstream = branch.upstream()) {
-      if (ahead < 0)
-        ahead = branch.difference(upstream);
-      if (behind < 0)
-        behind = upstream.difference(branch);
-
-      QStringList parts;
-      if (ahead > 0)
-        parts.append(tr("ahead: %1").arg(ahead));
-      if (behind > 0)
-        parts.append(tr("behind: %1").arg(behind));
-
-      QString status = parts.isEmpty() ? tr("up-to-date") : parts.join(", ");
-      QString remote = tr("%1 (%2)").arg(status, upstream.name());
+      // Counts that aren't cached yet are being computed
+      // in the background. Leave them out for now.
+      bool known = (ahead >= 0 && behind >= 0);
+      if (!known) {
+        git::Commit local = branch.target();
+        git::Commit remote = upstream.target();
+        known = repo.cachedAheadBehind(local, remote, ahead, behind);
+      }
+
+      QString remote = upstream.name();
+      if (known) {
+        QStringList parts;
+        if (ahead > 0)
+          parts.append(tr("ahead: %1").arg(ahead));
+        if (behind > 0)
+          parts.append(tr("behind: %1").arg(behind));
+
+        QString status =
+          parts.isEmpty() ? tr("up-to-date") : parts.join(", ");
+        remote = tr("%1 (%2)").arg(status, remote);
+      }
+
       title = tr("%1 - %2").arg(title, remote);
     }
   }
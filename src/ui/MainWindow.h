@@ -11,6 +11,7 @@
 #define MAINWINDOW_H
 
 #include "git/Repository.h"
+#include <QFutureWatcher>
 #include <QMainWindow>
 
 class RepoView;
@@ -72,6 +73,11 @@ private:
   void updateInterface();
   void updateWindowTitle(int ahead = -1, int behind = -1);
 
+  void startAheadBehind(
+    const git::Repository &repo,
+    const git::Commit &local,
+    const git::Commit &upstream);
+
   static void warnInvalidRepo(const QString &path);
 
   QStringList paths() const;
@@ -81,6 +87,8 @@ private:
   void updateTouchBar(int ahead = -1, int behind = -1);
 
   ToolBar *mToolBar;
+  QFutureWatcher<bool> mAheadBehind;
+  bool mAheadBehindPending = false;
   bool mFullPath = false;
   bool mIsSideBarVisible = true;
 
@@ -578,6 +578,14 @@ MenuBar::MenuBar(QWidget *parent)
     view()->history()->next();
   });
 
+  historyMenu->addSeparator();
+
+  mGoToDate = historyMenu->addAction(tr("Go to Date..."));
+  mGoToDate->setShortcut(tr("Ctrl+Shift+D"));
+  connect(mGoToDate, &QAction::triggered, [this] {
+    view()->promptToGoToDate();
+  });
+
   // Window
   QMenu *windowMenu = addMenu(tr("Window"));
   mPrevTab = windowMenu->addAction(tr("Show Previous Tab"));
@@ -915,6 +923,7 @@ void MenuBar::updateHistory()
   RepoView *view = win ? win->currentView() : nullptr;
   mPrev->setEnabled(view && view->history()->hasPrev());
   mNext->setEnabled(view && view->history()->hasNext());
+  mGoToDate->setEnabled(view);
 }
 
 void MenuBar::updateWindow()
@@ -106,6 +106,7 @@ private:
   // History
   QAction *mPrev;
   QAction *mNext;
+  QAction *mGoToDate;
 
   // Window
   QAction *mPrevTab;
@@ -44,8 +44,12 @@
 #include "watcher/RepositoryWatcher.h"
 #include <QCheckBox>
 #include <QCloseEvent>
+#include <QDateEdit>
 #include <QDesktopServices>
+#include <QDialogButtonBox>
+#include <QFormLayout>
 #include <QMessageBox>
+#include <QProgressDialog>
 #include <QtNetwork>
 #include <QPushButton>
 #include <QSettings>
@@ -414,6 +418,26 @@ RepoView::RepoView(const git::Repository &repo, MainWindow *parent)
     error(mLogRoot, "stage");
   });
 
+  // Show progress after adding many files takes a while.
+  connect(notifier, &git::RepositoryNotifier::indexStageProgress,
+  [this](int value, int total, bool &canceled) {
+    if (value >= total) {
+      delete mStageProgress;
+      mStageProgress = nullptr;
+      return;
+    }
+
+    if (!mStageProgress) {
+      mStageProgress = new QProgressDialog(
+        tr("Staging files..."), tr("Cancel"), 0, total, this);
+      mStageProgress->setWindowModality(Qt::WindowModal);
+      mStageProgress->setMinimumDuration(500);
+    }
+
+    mStageProgress->setValue(value);
+    canceled = mStageProgress->wasCanceled();
+  });
+
   connect(notifier, &git::RepositoryNotifier::lfsNotFound, [this] {
     QString text =
       tr("Git LFS was not found on the PATH. "
@@ -573,6 +597,35 @@ void RepoView::cancelBackgroundTasks()
   mDetails->cancelBackgroundTasks();
 }
 
+void RepoView::promptToGoToDate()
+{
+  QDialog *dialog = new QDialog(this);
+  dialog->setAttribute(Qt::WA_DeleteOnClose);
+  dialog->setWindowTitle(tr("Go to Date"));
+
+  QDateEdit *edit = new QDateEdit(QDate::currentDate(), dialog);
+  edit->setCalendarPopup(true);
+  edit->setDisplayFormat("yyyy-MM-dd");
+  edit->setMaximumDate(QDate::currentDate());
+
+  QDialogButtonBox *buttons =
+    new QDialogButtonBox(QDialogButtonBox::Ok | QDialogButtonBox::Cancel);
+  connect(buttons, &QDialogButtonBox::accepted, dialog, &QDialog::accept);
+  connect(buttons, &QDialogButtonBox::rejected, dialog, &QDialog::reject);
+
+  QFormLayout *layout = new QFormLayout(dialog);
+  layout->addRow(tr("Date:"), edit);
+  layout->addRow(buttons);
+
+  // Include every commit on the chosen day.
+  connect(dialog, &QDialog::accepted, this, [this, edit] {
+    QDateTime date(edit->date(), QTime(23, 59, 59));
+    visitLink(QString("date:%1").arg(date.toString(Qt::ISODate)));
+  });
+
+  dialog->open();
+}
+
 void RepoView::visitLink(const QString &link)
 {
   ScopedCollapse collapse(mLogView);
@@ -598,6 +651,14 @@ void RepoView::visitLink(const QString &link)
     return;
   }
 
+  // commit date
+  if (url.scheme() == "date") {
+    QDateTime date = QDateTime::fromString(url.path(), Qt::ISODate);
+    if (date.isValid())
+      mCommits->selectDate(date, true);
+    return;
+  }
+
   // submodule
   if (url.scheme() == "submodule") {
     openSubmodule(mRepo.lookupSubmodule(url.path()));
@@ -37,6 +37,7 @@ class LogEntry;
 class LogView;
 class MainWindow;
 class PathspecWidget;
+class QProgressDialog;
 class ReferenceWidget;
 class RemoteCallbacks;
 class ToolBar;
@@ -115,6 +116,9 @@ public:
   // links
   void visitLink(const QString &link);
 
+  // Prompt for a date and select the first commit at or before it.
+  void promptToGoToDate();
+
   // history location
   Location location() const;
   void setLocation(const Location &location);
@@ -340,6 +344,8 @@ private:
   RemoteCallbacks *mCallbacks = nullptr;
   QFutureWatcher<git::Result> *mWatcher = nullptr;
 
+  QProgressDialog *mStageProgress = nullptr;
+
   QList<QWidget *> mTrackedWindows;
 
   bool mShown = false;
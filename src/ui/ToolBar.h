@@ -29,6 +29,7 @@ public:
   SearchField *searchField() const { return mSearchField; }
 
 private:
+  // Negative counts are unknown and show no badge.
   void updateButtons(int ahead, int behind);
   void updateRemote(int ahead, int behind);
   void updateHistory();
@@ -13,6 +13,7 @@
 #include "git/Diff.h"
 #include "git/RevWalk.h"
 #include "git/Submodule.h"
+#include <QSet>
 #include <QStringBuilder>
 #include <QUrl>
 
@@ -24,7 +25,10 @@ const QString kLinkFmt = "<a href='%1'>%2</a>";
 
 TreeModel::TreeModel(const git::Repository &repo, QObject *parent)
   : QAbstractItemModel(parent), mRepo(repo)
-{}
+{
+  connect(repo.notifier(), &git::RepositoryNotifier::indexChanged,
+          this, &TreeModel::updateCheckState);
+}
 
 TreeModel::~TreeModel()
 {
@@ -44,6 +48,36 @@ void TreeModel::setTree(
   mDiff = diff;
   mIndex = index;
 
+  // Aggregate the diff by path.
+  mCounts.clear();
+  mStaged.clear();
+  if (diff.isValid()) {
+    if (index.isValid())
+      index.prefetchStagedStates(diff);
+
+    int count = diff.count();
+    for (int i = 0; i < count; ++i) {
+      QString name = diff.name(i);
+      bool staged = false;
+      if (index.isValid()) {
+        switch (index.isStaged(name)) {
+          case git::Index::Disabled:
+          case git::Index::Unstaged:
+          case git::Index::Conflicted:
+            break;
+
+          case git::Index::PartiallyStaged:
+          case git::Index::Staged:
+            staged = true;
+            break;
+        }
+      }
+
+      mStaged.insert(name, staged);
+      addCounts(name, 1, staged, git::Diff::statusChar(diff.status(i)));
+    }
+  }
+
   endResetModel();
 }
 
@@ -110,35 +144,14 @@ QVariant TreeModel::data(const QModelIndex &index, int role) const
       if (!mDiff.isValid() || !mIndex.isValid())
         return QVariant();
 
-      QStringList paths;
-      QString prefix = node->path(true);
-      for (int i = 0; i < mDiff.count(); ++i) {
-        QString path = mDiff.name(i);
-        if (path.startsWith(prefix))
-          paths.append(path);
-      }
-
-      if (paths.isEmpty())
+      auto it = mCounts.constFind(node->path(true));
+      if (it == mCounts.constEnd())
         return QVariant();
 
-      int count = 0;
-      foreach (const QString &path, paths) {
-        switch (mIndex.isStaged(path)) {
-          case git::Index::Disabled:
-          case git::Index::Unstaged:
-          case git::Index::Conflicted:
-            break;
-
-          case git::Index::PartiallyStaged:
-          case git::Index::Staged:
-            ++count;
-            break;
-        }
-      }
-
-      if (count == 0) {
+      const Counts &counts = it.value();
+      if (counts.staged == 0) {
         return Qt::Unchecked;
-      } else if (count == paths.size()) {
+      } else if (counts.staged == counts.total) {
         return Qt::Checked;
       } else {
         return Qt::PartiallyChecked;
@@ -170,22 +183,8 @@ QVariant TreeModel::data(const QModelIndex &index, int role) const
       return kLinkFmt.arg(url.toString(), commit.shortId());
     }
 
-    case StatusRole: {
-      if (!mDiff.isValid())
-        return QString();
-
-      QString status;
-      QString prefix = node->path(true);
-      for (int i = 0; i < mDiff.count(); ++i) {
-        if (mDiff.name(i).startsWith(prefix)) {
-          QChar ch = git::Diff::statusChar(mDiff.status(i));
-          if (!status.contains(ch))
-            status.append(ch);
-        }
-      }
-
-      return status;
-    }
+    case StatusRole:
+      return mCounts.value(node->path(true)).status;
   }
 
   return QVariant();
@@ -200,10 +199,11 @@ bool TreeModel::setData(
     case Qt::CheckStateRole: {
       QStringList files;
       Node *node = this->node(index);
-      QString prefix = node->path(true);
+      QString path = node->path(true);
+      QString prefix = path.endsWith('/') ? path : path + '/';
       for (int i = 0; i < mDiff.count(); ++i) {
         QString file = mDiff.name(i);
-        if (file.startsWith(prefix))
+        if (file == path || file.startsWith(prefix))
           files.append(file);
       }
 
@@ -226,6 +226,95 @@ TreeModel::Node *TreeModel::node(const QModelIndex &index) const
   return index.isValid() ? static_cast<Node *>(index.internalPointer()) : mRoot;
 }
 
+void TreeModel::addCounts(
+  const QString &file,
+  int total,
+  int staged,
+  const QChar &status)
+{
+  // Untracked dirs end with a slash.
+  QString path = file;
+  if (path.endsWith('/'))
+    path.chop(1);
+
+  forever {
+    Counts &counts = mCounts[path];
+    counts.total += total;
+    counts.staged += staged;
+    if (!status.isNull() && !counts.status.contains(status))
+      counts.status.append(status);
+
+    int pos = path.lastIndexOf('/');
+    if (pos < 0)
+      break;
+
+    path.truncate(pos);
+  }
+}
+
+void TreeModel::updateCheckState(const QStringList &paths)
+{
+  if (!mIndex.isValid())
+    return;
+
+  // Only the counts of parents of changed files have to be updated.
+  QStringList changed;
+  foreach (const QString &path, paths) {
+    auto it = mStaged.find(path);
+    if (it == mStaged.end())
+      continue;
+
+    bool staged = false;
+    switch (mIndex.isStaged(path)) {
+      case git::Index::Disabled:
+      case git::Index::Unstaged:
+      case git::Index::Conflicted:
+        break;
+
+      case git::Index::PartiallyStaged:
+      case git::Index::Staged:
+        staged = true;
+        break;
+    }
+
+    if (staged != it.value()) {
+      it.value() = staged;
+      addCounts(path, 0, staged ? 1 : -1);
+      changed.append(path);
+    }
+  }
+
+  // Collect the loaded dirs that contain changed files. Rows
+  // that haven't been loaded can't be visible.
+  QSet<Node *> parents;
+  foreach (const QString &path, changed) {
+    Node *node = mRoot;
+    foreach (const QString &name, path.split('/')) {
+      if (!node)
+        break;
+
+      parents.insert(node);
+      node = node->child(name);
+    }
+  }
+
+  // Repaint the rows of each dir.
+  foreach (Node *parent, parents) {
+    QModelIndex index;
+    if (parent != mRoot) {
+      Node *grandparent = parent->parent();
+      index = createIndex(grandparent->children().indexOf(parent), 0, parent);
+    }
+
+    int rows = parent->children().size();
+    if (rows) {
+      emit dataChanged(this->index(0, 0, index),
+                       this->index(rows - 1, 0, index),
+                       {Qt::CheckStateRole});
+    }
+  }
+}
+
 TreeModel::Node::Node(const QString &name, const git::Object &obj, Node *parent)
   : mName(name), mObject(obj), mParent(parent)
 {}
@@ -268,6 +357,16 @@ QList<TreeModel::Node *> TreeModel::Node::children()
   return mChildren;
 }
 
+TreeModel::Node *TreeModel::Node::child(const QString &name) const
+{
+  foreach (Node *child, mChildren) {
+    if (child->mName == name)
+      return child;
+  }
+
+  return nullptr;
+}
+
 git::Object TreeModel::Node::object() const
 {
   return mObject;
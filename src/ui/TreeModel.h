@@ -16,6 +16,7 @@
 #include "git/Repository.h"
 #include <QAbstractItemModel>
 #include <QFileIconProvider>
+#include <QHash>
 
 class TreeModel : public QAbstractItemModel
 {
@@ -75,6 +76,9 @@ private:
     bool hasChildren() const;
     QList<Node *> children();
 
+    // Find a child without loading the children.
+    Node *child(const QString &name) const;
+
     git::Object object() const;
 
   private:
@@ -85,14 +89,34 @@ private:
     QList<Node *> mChildren;
   };
 
+  // Aggregate state of the diff files at or below a path.
+  struct Counts
+  {
+    int total = 0;
+    int staged = 0;
+    QString status;
+  };
+
   Node *node(const QModelIndex &index) const;
 
+  // Add to the counts of the file and each of its parent dirs.
+  void addCounts(
+    const QString &file,
+    int total,
+    int staged,
+    const QChar &status = QChar());
+  void updateCheckState(const QStringList &paths);
+
   Node *mRoot = nullptr;
   QFileIconProvider mIconProvider;
 
   git::Diff mDiff;
   git::Index mIndex;
   git::Repository mRepo;
+
+  // Counts keyed by relative path and whether each diff file is staged
+  QHash<QString,Counts> mCounts;
+  QHash<QString,bool> mStaged;
 };
 
 #endif
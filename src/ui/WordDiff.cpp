@@ -0,0 +1,268 @@
+//
+//          Copyright (c) 2016, Scientific Toolworks, Inc.
+//
+// This software is licensed under the MIT License. The LICENSE.md file
+// describes the conditions under which this software may be distributed.
+//
+// Author: Jason Haslam
+//
+
+#include "WordDiff.h"
+#include <cstring>
+
+namespace {
+
+// Give up on finding a minimal diff for lines that have more
+// edits than this. The whole changed span is highlighted instead.
+const int kMaxEdits = 256;
+
+struct Token
+{
+  int pos;
+  int length;
+  uint hash;
+};
+
+uint hash(const char *data, int length)
+{
+  // FNV-1a
+  uint hash = 2166136261u;
+  for (int i = 0; i < length; ++i) {
+    hash ^= static_cast<uchar>(data[i]);
+    hash *= 16777619u;
+  }
+
+  return hash;
+}
+
+class Myers
+{
+public:
+  Myers(const char *data, const QVector<Token> &a, const QVector<Token> &b)
+    : mData(data), mA(a), mB(b)
+  {}
+
+  // Mark changed tokens in the flag vectors. Return false if the
+  // number of edits exceeds the limit. The flags are unspecified.
+  bool run(QVector<bool> &deleted, QVector<bool> &inserted)
+  {
+    // Skip common prefix and suffix.
+    int n = mA.size();
+    int m = mB.size();
+    int begin = 0;
+    while (begin < n && begin < m && equal(begin, begin))
+      ++begin;
+
+    while (n > begin && m > begin && equal(n - 1, m - 1)) {
+      --n;
+      --m;
+    }
+
+    return run(begin, n, m, deleted, inserted);
+  }
+
+private:
+  bool equal(int i, int j) const
+  {
+    const Token &a = mA.at(i);
+    const Token &b = mB.at(j);
+    return (a.hash == b.hash && a.length == b.length &&
+            !memcmp(mData + a.pos, mData + b.pos, a.length));
+  }
+
+  bool run(
+    int begin,
+    int n,
+    int m,
+    QVector<bool> &deleted,
+    QVector<bool> &inserted)
+  {
+    int oldCount = n - begin;
+    int newCount = m - begin;
+    if (oldCount == 0 || newCount == 0) {
+      for (int i = begin; i < n; ++i)
+        deleted[i] = true;
+      for (int j = begin; j < m; ++j)
+        inserted[j] = true;
+      return true;
+    }
+
+    // Record the furthest reaching x on each diagonal k for every
+    // edit count d. Diagonals -d..d are stored starting at d * d.
+    int max = qMin(oldCount + newCount, kMaxEdits);
+    int offset = max + 1;
+    QVector<int> v(2 * max + 3, 0);
+    QVector<int> trace;
+
+    int d = 0;
+    for (; d <= max; ++d) {
+      bool done = false;
+      for (int k = -d; k <= d; k += 2) {
+        int x;
+        if (k == -d || (k != d && v[offset + k - 1] < v[offset + k + 1])) {
+          x = v[offset + k + 1];
+        } else {
+          x = v[offset + k - 1] + 1;
+        }
+
+        int y = x - k;
+        while (x < oldCount && y < newCount && equal(begin + x, begin + y)) {
+          ++x;
+          ++y;
+        }
+
+        v[offset + k] = x;
+        if (x >= oldCount && y >= newCount)
+          done = true;
+      }
+
+      for (int k = -d; k <= d; ++k)
+        trace.append(v[offset + k]);
+
+      if (done)
+        break;
+    }
+
+    if (d > max)
+      return false;
+
+    // Walk back through the trace to find the edits.
+    int x = oldCount;
+    int y = newCount;
+    for (; d > 0; --d) {
+      // The previous row holds diagonals -(d - 1)..(d - 1).
+      const int *prev = trace.constData() + (d - 1) * (d - 1) + (d - 1);
+
+      int k = x - y;
+      bool down = (k == -d || (k != d && prev[k - 1] < prev[k + 1]));
+      int prevK = down ? k + 1 : k - 1;
+      int prevX = prev[prevK];
+      int prevY = prevX - prevK;
+
+      // Skip matching tokens.
+      while (x > prevX && y > prevY) {
+        --x;
+        --y;
+      }
+
+      if (down) {
+        inserted[begin + prevY] = true;
+      } else {
+        deleted[begin + prevX] = true;
+      }
+
+      x = prevX;
+      y = prevY;
+    }
+
+    return true;
+  }
+
+  const char *mData;
+  const QVector<Token> &mA;
+  const QVector<Token> &mB;
+};
+
+void append(
+  QVector<WordDiff::Range> &ranges,
+  const QVector<Token> &tokens,
+  const QVector<bool> &changed)
+{
+  int count = tokens.size();
+  for (int i = 0; i < count; ++i) {
+    if (!changed.at(i))
+      continue;
+
+    int start = i;
+    while (i + 1 < count && changed.at(i + 1))
+      ++i;
+
+    const Token &last = tokens.at(i);
+    int pos = tokens.at(start).pos;
+    ranges.append({pos, last.pos + last.length - pos});
+  }
+}
+
+} // anon. namespace
+
+WordDiff::WordDiff(const QByteArray &wordChars, const QByteArray &spaceChars)
+{
+  memset(mClasses, Other, sizeof(mClasses));
+  foreach (char ch, spaceChars)
+    mClasses[static_cast<uchar>(ch)] = Space;
+  foreach (char ch, wordChars)
+    mClasses[static_cast<uchar>(ch)] = Word;
+}
+
+WordDiff::Result WordDiff::diff(
+  const QByteArray &text,
+  const QList<QPair<int,int>> &lines) const
+{
+  Result result;
+  if (lines.isEmpty())
+    return result;
+
+  // Find line starts. Lines end like they do in the editor:
+  // at "\r\n", at "\n" or at a lone '\r'.
+  const char *data = text.constData();
+  int size = text.size();
+  QVector<int> starts = {0};
+  for (int i = 0; i < size; ++i) {
+    if (data[i] == '\r' && i + 1 < size && data[i + 1] == '\n')
+      ++i;
+
+    if (data[i] == '\n' || data[i] == '\r')
+      starts.append(i + 1);
+  }
+
+  // Split a line into tokens, excluding the line ending.
+  auto tokenize = [this, data, size, &starts](
+    int line,
+    QVector<Token> &tokens)
+  {
+    tokens.resize(0);
+    if (line < 0 || line >= starts.size())
+      return;
+
+    int pos = starts.at(line);
+    int end = (line + 1 < starts.size()) ? starts.at(line + 1) : size;
+    while (end > pos && (data[end - 1] == '\n' || data[end - 1] == '\r'))
+      --end;
+
+    while (pos < end) {
+      char cls = mClasses[static_cast<uchar>(data[pos])];
+      int tokenEnd = pos + 1;
+      if (cls != Other) {
+        while (tokenEnd < end &&
+               mClasses[static_cast<uchar>(data[tokenEnd])] == cls)
+          ++tokenEnd;
+      }
+
+      int length = tokenEnd - pos;
+      tokens.append({pos, length, hash(data + pos, length)});
+      pos = tokenEnd;
+    }
+  };
+
+  QVector<Token> oldTokens;
+  QVector<Token> newTokens;
+  QVector<bool> deleted;
+  QVector<bool> inserted;
+  foreach (const auto &pair, lines) {
+    tokenize(pair.first, oldTokens);
+    tokenize(pair.second, newTokens);
+
+    deleted.fill(false, oldTokens.size());
+    inserted.fill(false, newTokens.size());
+    if (!Myers(data, oldTokens, newTokens).run(deleted, inserted)) {
+      // Too many edits. Treat the whole line as changed.
+      deleted.fill(true);
+      inserted.fill(true);
+    }
+
+    append(result.deletions, oldTokens, deleted);
+    append(result.additions, newTokens, inserted);
+  }
+
+  return result;
+}
@@ -0,0 +1,57 @@
+//
+//          Copyright (c) 2016, Scientific Toolworks, Inc.
+//
+// This software is licensed under the MIT License. The LICENSE.md file
+// describes the conditions under which this software may be distributed.
+//
+// Author: Jason Haslam
+//
+
+#ifndef WORDDIFF_H
+#define WORDDIFF_H
+
+#include <QByteArray>
+#include <QList>
+#include <QPair>
+#include <QVector>
+
+// Compute intra-line differences between pairs of lines in a text
+// buffer. Lines are split into runs of word characters, runs of
+// whitespace and single punctuation characters. The token sequences
+// are diffed with the Myers algorithm by comparing token hashes. Each
+// instance is immutable, so diff() can be called from any thread.
+class WordDiff
+{
+public:
+  struct Range
+  {
+    int pos;
+    int length;
+  };
+
+  struct Result
+  {
+    QVector<Range> deletions;
+    QVector<Range> additions;
+  };
+
+  // The character classes usually come from the editor
+  // that will show the result so that tokens match words.
+  WordDiff(const QByteArray &wordChars, const QByteArray &spaceChars);
+
+  // Diff each pair of lines given as zero-based (old, new) line
+  // indexes into text. Ranges are byte offsets into text.
+  Result diff(const QByteArray &text, const QList<QPair<int,int>> &lines) const;
+
+private:
+  enum CharClass
+  {
+    Other,
+    Word,
+    Space
+  };
+
+  char mClasses[256];
+};
+
+#endif
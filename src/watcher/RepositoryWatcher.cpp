@@ -9,16 +9,63 @@
 
 #include "RepositoryWatcher.h"
 
+namespace {
+
+// Fall back to a full rescan when too many paths change at once.
+const int kMaxPaths = 1024;
+
+// Wait for changes to settle before notifying. The delay starts short
+// and doubles while events keep arriving. It only drops back after a
+// quiet period, and a notification is never held back for longer than
+// the maximum wait.
+const int kMinDelay = 200;
+const int kMaxDelay = 2000;
+const int kMaxWait = 8000;
+
+} // anon. namespace
+
 void RepositoryWatcher::init(const git::Repository &repo)
 {
   // The timer has to run on the main thread.
-  mTimer.setInterval(2000);
   mTimer.setSingleShot(true);
-  connect(&mTimer, &QTimer::timeout,
-          repo.notifier(), &git::RepositoryNotifier::workdirChanged);
+  connect(&mTimer, &QTimer::timeout, [this, repo] {
+    QStringList paths = mOverflow ? QStringList() : mPaths.toList();
+    mPaths.clear();
+    mOverflow = false;
+    emit repo.notifier()->workdirChanged(paths);
+  });
 }
 
 void RepositoryWatcher::cancelPendingNotification()
 {
   mTimer.stop();
+  mPaths.clear();
+  mOverflow = false;
+}
+
+void RepositoryWatcher::notify(const QStringList &paths)
+{
+  if (paths.isEmpty()) {
+    mOverflow = true;
+  } else if (!mOverflow) {
+    mPaths.unite(paths.toSet());
+    if (mPaths.size() > kMaxPaths) {
+      mPaths.clear();
+      mOverflow = true;
+    }
+  }
+
+  // Back off during event storms.
+  bool storm = (mLastEvent.isValid() && mLastEvent.elapsed() < kMaxDelay);
+  mLastEvent.start();
+  if (mTimer.isActive()) {
+    mDelay = qMin(2 * mDelay, kMaxDelay);
+  } else {
+    mFirstEvent.start();
+    if (!storm)
+      mDelay = kMinDelay;
+  }
+
+  qint64 remaining = kMaxWait - mFirstEvent.elapsed();
+  mTimer.start(qMax<qint64>(0, qMin<qint64>(mDelay, remaining)));
 }
@@ -11,7 +11,9 @@
 #define REPOSITORYWATCHER_H
 
 #include "git/Repository.h"
+#include <QElapsedTimer>
 #include <QObject>
+#include <QSet>
 #include <QTimer>
 
 class RepositoryWatcherPrivate;
@@ -26,7 +28,16 @@ public:
   void cancelPendingNotification();
 
 private:
+  // Collect changed paths relative to the workdir until the timer
+  // fires. An empty list means that the changes are unknown.
+  void notify(const QStringList &paths);
+
   QTimer mTimer;
+  int mDelay = 0;
+  QElapsedTimer mLastEvent;
+  QElapsedTimer mFirstEvent;
+  QSet<QString> mPaths;
+  bool mOverflow = false;
   RepositoryWatcherPrivate *d;
 };
 
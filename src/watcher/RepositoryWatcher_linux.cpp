@@ -8,8 +8,12 @@
 //
 
 #include "RepositoryWatcher.h"
-#include <QMap>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QSet>
 #include <QThread>
+#include <errno.h>
 #include <poll.h>
 #include <unistd.h>
 #include <sys/inotify.h>
@@ -23,13 +27,25 @@ const uint kFlags =
    IN_DELETE |
    IN_DELETE_SELF |
    IN_MODIFY |
-   IN_MOVE_SELF);
+   IN_MOVE_SELF |
+   IN_MOVED_FROM |
+   IN_MOVED_TO);
 
-// FIXME: Include hidden and filter .git explicitly?
-const QDir::Filters kFilters =
-  (QDir::Dirs |
+const QDir::Filters kScanFilters =
+  (QDir::AllEntries |
+   QDir::Hidden |
    QDir::NoDotAndDotDot);
 
+// Register this many directories between reading notifications.
+const int kRegisterCount = 64;
+
+// Scan directories that couldn't be watched at this interval.
+// Recently changed directories are scanned every time. The rest
+// are scanned a few at a time.
+const int kScanInterval = 3000;
+const int kScanCount = 256;
+const int kHotCount = 64;
+
 } // anon. namespace
 
 class RepositoryWatcherPrivate : public QThread
@@ -40,7 +56,7 @@ public:
   RepositoryWatcherPrivate(
     const git::Repository &repo,
     QObject *parent = nullptr)
-    : QThread(parent), mRepo(repo)
+    : QThread(parent), mRepo(repo), mRoot(repo.workdir().path())
   {
     mFd = inotify_init1(IN_NONBLOCK);
     if (mFd < 0)
@@ -64,17 +80,26 @@ public:
 
   void run() override
   {
-    // Watch the root directory.
-    watch(mRepo.workdir());
+    // Watch the root directory. Subdirectories are registered
+    // breadth-first in batches between reading notifications.
+    mQueue.append(QString());
+    mScanTimer.start();
 
-    // Start listening for notifications.
     forever {
+      // Don't block while there are directories left to register.
+      int timeout = -1;
+      if (!mQueue.isEmpty()) {
+        timeout = 0;
+      } else if (!mScanOrder.isEmpty()) {
+        timeout = qMax<qint64>(0, kScanInterval - mScanTimer.elapsed());
+      }
+
       pollfd pollFds[2];
       pollFds[0].fd = mPipe[0];
       pollFds[0].events = POLLIN;
       pollFds[1].fd = mFd;
       pollFds[1].events = POLLIN;
-      if (poll(pollFds, 2, -1) < 0)
+      if (poll(pollFds, 2, timeout) < 0)
         return; // FIXME: Report error?
 
       // Check for signal to quit.
@@ -82,68 +107,237 @@ public:
         return;
 
       // Check for notifications.
-      if (!(pollFds[1].revents & POLLIN))
-        continue;
+      if (pollFds[1].revents & POLLIN)
+        read();
 
-      // Read notifications.
-      bool ignored = true;
-      forever {
-        char buf[4096];
-        int len = read(mFd, buf, sizeof(buf));
-        if (len <= 0)
-          break;
-
-        const inotify_event *event = nullptr;
-        for (char *ptr = buf; ptr < buf + len;
-             ptr += sizeof(inotify_event) + event->len) {
-          event = reinterpret_cast<inotify_event *>(ptr);
-          if (event->len && !mRepo.isIgnored(event->name)) {
-            ignored = false;
-
-            // Start watching new directories.
-            int mask = (IN_CREATE | IN_ISDIR);
-            if ((event->mask & mask) == mask)
-              watch(mWds.value(event->wd).filePath(event->name));
-          }
+      if (!mQueue.isEmpty()) {
+        watch(kRegisterCount);
+      } else if (!mScanOrder.isEmpty() &&
+                 mScanTimer.elapsed() >= kScanInterval) {
+        scan();
+        mScanTimer.restart();
+      }
+    }
+  }
+
+  void stop()
+  {
+    if (write(mPipe[1], "\n", 1) < 0)
+      terminate(); // FIXME: Report error?
+  }
+
+signals:
+  void notificationReceived(const QStringList &paths);
+
+private:
+  // Paths are relative to the workdir. The root is the empty string.
+  QString absolute(const QString &path) const
+  {
+    return path.isEmpty() ? mRoot : mRoot + '/' + path;
+  }
+
+  static QString child(const QString &path, const QString &name)
+  {
+    return path.isEmpty() ? name : path + '/' + name;
+  }
+
+  // Read notifications. Collect paths relative to the workdir.
+  void read()
+  {
+    bool ignored = true;
+    bool overflow = false;
+    QSet<QString> paths;
+    forever {
+      char buf[4096];
+      int len = ::read(mFd, buf, sizeof(buf));
+      if (len <= 0)
+        break;
+
+      const inotify_event *event = nullptr;
+      for (char *ptr = buf; ptr < buf + len;
+           ptr += sizeof(inotify_event) + event->len) {
+        event = reinterpret_cast<inotify_event *>(ptr);
+
+        // Events were dropped. Everything has to be rescanned, and
+        // directories may have been created without being watched.
+        if (event->mask & IN_Q_OVERFLOW) {
+          ignored = false;
+          overflow = true;
+          continue;
+        }
+
+        // The watch was removed along with its directory.
+        if (event->mask & IN_IGNORED) {
+          mWds.remove(event->wd);
+          continue;
         }
+
+        auto it = mWds.constFind(event->wd);
+        if (!event->len || it == mWds.constEnd())
+          continue;
+
+        // Match ignore rules against the full path. Passing
+        // directories with a slash avoids checking their type.
+        QString path = child(it.value(), event->name);
+        bool dir = (event->mask & IN_ISDIR);
+        if (mRepo.isIgnored(dir ? path + '/' : path))
+          continue;
+
+        ignored = false;
+        paths.insert(path);
+
+        // Start watching new directories.
+        if (dir && (event->mask & (IN_CREATE | IN_MOVED_TO)))
+          mQueue.append(path);
+      }
+    }
+
+    if (overflow)
+      mQueue.append(QString());
+
+    if (!ignored)
+      emit notificationReceived(overflow ? QStringList() : paths.toList());
+  }
+
+  // Register the next count directories in the queue.
+  void watch(int count)
+  {
+    for (; count > 0 && !mQueue.isEmpty(); --count) {
+      QString path = mQueue.takeFirst();
+      QDir dir(absolute(path));
+
+      bool watched = true;
+      int wd = inotify_add_watch(mFd, dir.path().toUtf8(), kFlags);
+      if (wd >= 0) {
+        // Associate the dir with this watch descriptor.
+        mWds[wd] = path;
+      } else if (errno == ENOSPC) {
+        // Out of watches. Scan this dir for changes instead.
+        watched = false;
+      } else {
+        continue; // FIXME: Report error?
       }
 
-      if (!ignored)
-        emit notificationReceived();
+      // Queue subdirs.
+      QFileInfoList infos = dir.entryInfoList(kScanFilters);
+      foreach (const QFileInfo &info, infos) {
+        if (!info.isDir() || info.isHidden())
+          continue;
+
+        QString subdir = child(path, info.fileName());
+        if (!mRepo.isIgnored(subdir + '/'))
+          mQueue.append(subdir);
+      }
+
+      if (!watched) {
+        if (!mScans.contains(path))
+          mScanOrder.append(path);
+        mScans[path] = stamps(infos);
+      }
     }
   }
 
-  void watch(const QDir &dir)
+  // Compare the modification times of entries in unwatched directories.
+  void scan()
   {
-    int wd = inotify_add_watch(mFd, dir.path().toUtf8(), kFlags);
-    if (wd < 0)
-      return; // FIXME: Report error?
+    QSet<QString> paths;
+    QStringList hot = mHot;
+    for (int i = 0; i < kScanCount && i < mScanOrder.size(); ++i) {
+      mScanIndex = (mScanIndex + 1) % mScanOrder.size();
+      QString path = mScanOrder.at(mScanIndex);
+      if (!hot.contains(path))
+        hot.append(path);
+    }
 
-    // Associate the dir with this watch descriptor.
-    mWds[wd] = dir;
+    foreach (const QString &path, hot) {
+      QDir dir(absolute(path));
+      if (!dir.exists()) {
+        mScans.remove(path);
+        mScanOrder.removeOne(path);
+        mHot.removeOne(path);
+        mScanIndex = 0;
+        continue;
+      }
 
-    // Watch subdirs.
-    foreach (const QString &name, dir.entryList(kFilters)) {
-      QString path = dir.filePath(name);
-      if (!mRepo.isIgnored(path))
-        watch(path);
+      QFileInfoList infos = dir.entryInfoList(kScanFilters);
+      QHash<QString,qint64> current = stamps(infos);
+      QHash<QString,qint64> &previous = mScans[path];
+      if (current == previous)
+        continue;
+
+      foreach (const QFileInfo &info, infos) {
+        QString key = this->key(info);
+        if (!current.contains(key))
+          continue;
+
+        bool added = !previous.contains(key);
+        if (added || previous.value(key) != current.value(key)) {
+          QString entry = child(path, info.fileName());
+          if (!mRepo.isIgnored(child(path, key))) {
+            paths.insert(entry);
+            if (added && info.isDir() && !info.isHidden())
+              mQueue.append(entry);
+          }
+        }
+      }
+
+      // Removed directories are still known by their key.
+      foreach (const QString &key, previous.keys()) {
+        if (!current.contains(key)) {
+          QString entry = child(path, key);
+          if (!mRepo.isIgnored(entry)) {
+            if (entry.endsWith('/'))
+              entry.chop(1);
+            paths.insert(entry);
+          }
+        }
+      }
+
+      previous = current;
+
+      // Keep scanning recently changed dirs every time.
+      mHot.removeOne(path);
+      mHot.prepend(path);
+      if (mHot.size() > kHotCount)
+        mHot.removeLast();
     }
+
+    if (!paths.isEmpty())
+      emit notificationReceived(paths.toList());
   }
 
-  void stop()
+  // Directory names have a trailing '/' so that ignore
+  // rules can be matched without checking their type.
+  static QString key(const QFileInfo &info)
   {
-    if (write(mPipe[1], "\n", 1) < 0)
-      terminate(); // FIXME: Report error?
+    QString name = info.fileName();
+    return info.isDir() ? name + '/' : name;
   }
 
-signals:
-  void notificationReceived();
+  static QHash<QString,qint64> stamps(const QFileInfoList &infos)
+  {
+    QHash<QString,qint64> stamps;
+    foreach (const QFileInfo &info, infos) {
+      if (info.fileName() != ".git")
+        stamps.insert(key(info), info.lastModified().toMSecsSinceEpoch());
+    }
+
+    return stamps;
+  }
 
-private:
   git::Repository mRepo;
+  QString mRoot;
   int mFd = -1;
   int mPipe[2] = {-1, -1};
-  QMap<int,QDir> mWds;
+  QHash<int,QString> mWds;
+  QStringList mQueue;
+
+  // Directories that couldn't be watched.
+  QElapsedTimer mScanTimer;
+  QHash<QString,QHash<QString,qint64>> mScans;
+  QStringList mScanOrder;
+  QStringList mHot;
+  int mScanIndex = 0;
 };
 
 RepositoryWatcher::RepositoryWatcher(
@@ -153,10 +347,11 @@ RepositoryWatcher::RepositoryWatcher(
 {
   init(repo);
   connect(d, &RepositoryWatcherPrivate::notificationReceived,
-          &mTimer, static_cast<void (QTimer::*)()>(&QTimer::start));
+          this, &RepositoryWatcher::notify);
 
+  // Start registering watches after the view is shown.
   if (d->isValid())
-    d->start();
+    QTimer::singleShot(0, this, [this] { d->start(); });
 }
 
 RepositoryWatcher::~RepositoryWatcher()
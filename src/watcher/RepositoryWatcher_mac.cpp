@@ -73,19 +73,37 @@ public:
     RepositoryWatcherPrivate *watcher =
       static_cast<RepositoryWatcherPrivate *>(clientCallBackInfo);
 
-    // Filter out ignored directories.
+    // Filter out ignored directories. Events
+    // are reported for the parent directory.
+    QStringList changed;
+    bool overflow = false;
     git::Repository repo = watcher->repo();
+    QDir workdir = repo.workdir();
     const char **paths = static_cast<const char **>(eventPaths);
     for (int i = 0; i < numEvents; ++i) {
-      if (!repo.isIgnored(paths[i])) {
-        emit watcher->notificationReceived();
-        return;
-      }
+      QString path = workdir.relativeFilePath(QString::fromUtf8(paths[i]));
+      if (path == ".")
+        path.clear();
+
+      // Match as a directory without checking the filesystem.
+      if (!path.isEmpty() && repo.isIgnored(path + '/'))
+        continue;
+
+      changed.append(path);
+      if (eventFlags[i] & kFSEventStreamEventFlagMustScanSubDirs)
+        overflow = true;
     }
+
+    // A change at the root can't be narrowed down.
+    if (changed.contains(QString()))
+      overflow = true;
+
+    if (!changed.isEmpty())
+      emit watcher->notificationReceived(overflow ? QStringList() : changed);
   }
 
 signals:
-  void notificationReceived();
+  void notificationReceived(const QStringList &paths);
 
 private:
   git::Repository mRepo;
@@ -100,7 +118,7 @@ RepositoryWatcher::RepositoryWatcher(
 {
   init(repo);
   connect(d, &RepositoryWatcherPrivate::notificationReceived,
-          &mTimer, static_cast<void (QTimer::*)()>(&QTimer::start));
+          this, &RepositoryWatcher::notify);
 }
 
 RepositoryWatcher::~RepositoryWatcher() {}
@@ -108,7 +108,7 @@ public:
     DWORD numBytes,
     LPOVERLAPPED overlapped)
   {
-    if (errorCode || !numBytes)
+    if (errorCode)
       return; // FIXME: Report error?
 
     // Copy buffer and restart.
@@ -117,7 +117,14 @@ public:
     QVector<BYTE> buffer = watcher->buffer();
     watcher->watch();
 
+    // The buffer overflowed. Everything has to be rescanned.
+    if (!numBytes) {
+      emit watcher->notificationReceived(QStringList());
+      return;
+    }
+
     // Iterate over notifications.
+    QStringList paths;
     git::Repository repo = watcher->repo();
     const BYTE *ptr = buffer.constData();
     forever {
@@ -127,20 +134,21 @@ public:
       int size = info->FileNameLength / sizeof(wchar_t);
       QString native = QString::fromWCharArray(info->FileName, size);
       QString path = QDir::fromNativeSeparators(native);
-      if (!path.isEmpty() && !repo.isIgnored(path)) {
-        emit watcher->notificationReceived();
-        return;
-      }
+      if (!path.isEmpty() && !repo.isIgnored(path) && !paths.contains(path))
+        paths.append(path);
 
       if (!info->NextEntryOffset)
-        return;
+        break;
 
       ptr += info->NextEntryOffset;
     }
+
+    if (!paths.isEmpty())
+      emit watcher->notificationReceived(paths);
   }
 
 signals:
-  void notificationReceived();
+  void notificationReceived(const QStringList &paths);
 
 private:
   git::Repository mRepo;
@@ -157,7 +165,7 @@ RepositoryWatcher::RepositoryWatcher(
 {
   init(repo);
   connect(d, &RepositoryWatcherPrivate::notificationReceived,
-          &mTimer, static_cast<void (QTimer::*)()>(&QTimer::start));
+          this, &RepositoryWatcher::notify);
 
   d->start();
 }
@@ -0,0 +1,98 @@
+//
+//          Copyright (c) 2016, Scientific Toolworks, Inc.
+//
+// This software is licensed under the MIT License. The LICENSE.md file
+// describes the conditions under which this software may be distributed.
+//
+// Author: Jason Haslam
+//
+
+#include "Test.h"
+#include "git/BloomFilter.h"
+
+using namespace QTest;
+
+class TestBloomFilter : public QObject
+{
+  Q_OBJECT
+
+private slots:
+  void invalid();
+  void falseNegatives();
+  void falsePositives();
+  void paths();
+  void roundTrip();
+};
+
+void TestBloomFilter::invalid()
+{
+  git::BloomFilter filter;
+  QVERIFY(!filter.isValid());
+  QVERIFY(filter.contains("anything"));
+  QVERIFY(filter.containsPath("any/path"));
+}
+
+void TestBloomFilter::falseNegatives()
+{
+  int count = 1000;
+  git::BloomFilter filter(count);
+  for (int i = 0; i < count; ++i)
+    filter.insert(QByteArray::number(i));
+
+  for (int i = 0; i < count; ++i)
+    QVERIFY(filter.contains(QByteArray::number(i)));
+}
+
+void TestBloomFilter::falsePositives()
+{
+  int count = 1000;
+  git::BloomFilter filter(count);
+  for (int i = 0; i < count; ++i)
+    filter.insert("key" + QByteArray::number(i));
+
+  // The expected rate is under 1% at ten bits per entry.
+  int positives = 0;
+  int trials = 100000;
+  for (int i = 0; i < trials; ++i) {
+    if (filter.contains("other" + QByteArray::number(i)))
+      ++positives;
+  }
+
+  QVERIFY2(positives < trials / 50, qPrintable(QString::number(positives)));
+}
+
+void TestBloomFilter::paths()
+{
+  git::BloomFilter filter = git::BloomFilter::changedPaths({
+    "README.md",
+    "src/git/Repository.cpp",
+    "src/ui/DiffView.cpp"
+  });
+
+  QVERIFY(filter.containsPath("README.md"));
+  QVERIFY(filter.containsPath("src/git/Repository.cpp"));
+  QVERIFY(filter.containsPath("src/ui/DiffView.cpp"));
+
+  // Leading directories are included with or without a slash.
+  QVERIFY(filter.containsPath("src"));
+  QVERIFY(filter.containsPath("src/"));
+  QVERIFY(filter.containsPath("src/git"));
+  QVERIFY(filter.containsPath("src/ui/"));
+}
+
+void TestBloomFilter::roundTrip()
+{
+  git::BloomFilter filter(100);
+  for (int i = 0; i < 100; ++i)
+    filter.insert(QByteArray::number(i));
+
+  git::BloomFilter copy(filter.data());
+  QVERIFY(copy.isValid());
+  QCOMPARE(copy.data(), filter.data());
+  for (int i = 0; i < 100; ++i)
+    QVERIFY(copy.contains(QByteArray::number(i)));
+}
+
+TEST_MAIN(TestBloomFilter)
+
+#include "bloom_filter.moc"
@@ -0,0 +1,122 @@
+//
+//          Copyright (c) 2016, Scientific Toolworks, Inc.
+//
+// This software is licensed under the MIT License. The LICENSE.md file
+// describes the conditions under which this software may be distributed.
+//
+// Author: Jason Haslam
+//
+
+#include "Test.h"
+#include "git/Config.h"
+#include <QFile>
+
+using namespace Test;
+using namespace QTest;
+
+namespace {
+
+bool write(const QString &path, const QByteArray &content)
+{
+  QFile file(path);
+  return file.open(QFile::WriteOnly) && file.write(content) >= 0;
+}
+
+} // anon. namespace
+
+class TestIgnore : public QObject
+{
+  Q_OBJECT
+
+private slots:
+  void initTestCase();
+  void isIgnored_data();
+  void isIgnored();
+
+private:
+  ScratchRepository mRepo;
+};
+
+void TestIgnore::initTestCase()
+{
+  // Rules are read on the first lookup.
+  QDir workdir = mRepo->workdir();
+  QVERIFY(write(workdir.filePath(".gitignore"),
+    "# Comment\n"
+    "*.log\n"
+    "!keep.log\n"
+    "/anchored\n"
+    "build/\n"
+    "**/deep/*.tmp\n"
+    "doc/**/*.pdf\n"
+    "!keep.bak\n"));
+
+  QVERIFY(workdir.mkdir("sub"));
+  QVERIFY(write(workdir.filePath("sub/.gitignore"), "!*.log\nlocal\n"));
+
+  QDir dir = mRepo->dir();
+  QVERIFY(dir.mkpath("info"));
+  QVERIFY(write(dir.filePath("info/exclude"), "excluded\n"));
+
+  QString global = dir.filePath("global");
+  QVERIFY(write(global, "*.bak\n"));
+  mRepo->config().setValue("core.excludesfile", global);
+}
+
+void TestIgnore::isIgnored_data()
+{
+  QTest::addColumn<QString>("path");
+  QTest::addColumn<bool>("ignored");
+
+  // Patterns without a slash match at any level.
+  QTest::newRow("unanchored") << "debug.log" << true;
+  QTest::newRow("unanchored nested") << "src/debug.log" << true;
+
+  // Later negated rules take precedence.
+  QTest::newRow("negated") << "keep.log" << false;
+
+  // A leading slash anchors the pattern to the directory.
+  QTest::newRow("anchored") << "anchored" << true;
+  QTest::newRow("anchored nested") << "src/anchored" << false;
+
+  // Directory rules only match directories and their contents.
+  QTest::newRow("directory") << "build/" << true;
+  QTest::newRow("directory file") << "src/build" << false;
+  QTest::newRow("directory contents") << "build/out.o" << true;
+
+  // "**" matches any number of directories.
+  QTest::newRow("leading **") << "deep/a.tmp" << true;
+  QTest::newRow("leading ** nested") << "x/y/deep/a.tmp" << true;
+  QTest::newRow("leading ** below") << "deep/x/a.tmp" << false;
+  QTest::newRow("inner **") << "doc/a.pdf" << true;
+  QTest::newRow("inner ** nested") << "doc/x/y/a.pdf" << true;
+  QTest::newRow("inner ** anchored") << "other/doc/a.pdf" << false;
+
+  // The deepest ignore file takes precedence.
+  QTest::newRow("nested negated") << "sub/debug.log" << false;
+  QTest::newRow("nested") << "sub/local" << true;
+  QTest::newRow("nested outside") << "local" << false;
+
+  // The repository's exclude file applies to every path.
+  QTest::newRow("info/exclude") << "excluded" << true;
+  QTest::newRow("info/exclude nested") << "src/excluded" << true;
+
+  // The global file has the lowest precedence.
+  QTest::newRow("core.excludesFile") << "global.bak" << true;
+  QTest::newRow("core.excludesFile negated") << "keep.bak" << false;
+
+  // Files that aren't matched aren't ignored.
+  QTest::newRow("unmatched") << "src/main.cpp" << false;
+}
+
+void TestIgnore::isIgnored()
+{
+  QFETCH(QString, path);
+  QFETCH(bool, ignored);
+
+  QCOMPARE(mRepo->isIgnored(path), ignored);
+}
+
+TEST_MAIN(TestIgnore)
+
+#include "ignore.moc"
@@ -8,9 +8,14 @@
 //
 
 #include "Test.h"
+#include "git/Blob.h"
+#include "git/Diff.h"
+#include "git/Index.h"
+#include "git/Patch.h"
 #include "ui/FileList.h"
 #include "ui/MainWindow.h"
 #include "ui/RepoView.h"
+#include <QBitArray>
 #include <QFile>
 #include <QTextEdit>
 #include <QTextStream>
@@ -18,6 +23,23 @@
 using namespace Test;
 using namespace QTest;
 
+namespace {
+
+// Enough lines to separate hunks at both ends.
+QByteArray lines(bool newline = true)
+{
+  QByteArray content;
+  for (int i = 0; i < 20; ++i)
+    content += "Line " + QByteArray::number(i) + '\n';
+
+  if (!newline)
+    content.chop(1);
+
+  return content;
+}
+
+} // anon. namespace
+
 class TestIndex : public QObject
 {
   Q_OBJECT
@@ -27,6 +49,9 @@ private slots:
   void stageAddition();
   void stageDeletion();
   void stageDirectory();
+  void stageHunks();
+  void applyHunks_data();
+  void applyHunks();
   void cleanupTestCase();
 
 private:
@@ -177,6 +202,143 @@ void TestIndex::stageDirectory()
   QVERIFY(index2.data(Qt::CheckStateRole).toBool());
 }
 
+void TestIndex::stageHunks()
+{
+  // Track a file with enough lines to separate two hunks.
+  QByteArray base = lines();
+
+  QFile file(mRepo->workdir().filePath("hunks"));
+  QVERIFY(file.open(QFile::WriteOnly));
+  file.write(base);
+  file.close();
+
+  git::Index index = mRepo->index();
+  index.setStaged({"hunks"}, true);
+  QCOMPARE(index.isStaged("hunks"), git::Index::Staged);
+
+  // Change the first and last few lines.
+  QByteArray first = base;
+  first.replace("Line 2\n", "Line 2 changed\n");
+  QByteArray both = first;
+  both.replace("Line 17\n", "Line 17 changed\n");
+
+  QVERIFY(file.open(QFile::WriteOnly));
+  file.write(both);
+  file.close();
+
+  git::Diff diff = mRepo->diffIndexToWorkdir(nullptr, {"hunks"});
+  QCOMPARE(diff.count(), 1);
+
+  git::Patch patch = diff.patch(0);
+  QCOMPARE(patch.count(), 2);
+
+  // Stage only the first hunk.
+  size_t size = 0;
+  QBitArray hunks(2);
+  hunks.setBit(0);
+  git::Id id = patch.applyToOdb(hunks, &size);
+  QVERIFY(!id.isNull());
+  QCOMPARE(mRepo->lookupBlob(id).rawContent(), first);
+  QCOMPARE(size, static_cast<size_t>(first.size()));
+
+  index.add("hunks", id, size);
+  QCOMPARE(index.isStaged("hunks"), git::Index::PartiallyStaged);
+
+  // Stage both hunks.
+  hunks.fill(true);
+  id = patch.applyToOdb(hunks, &size);
+  QVERIFY(!id.isNull());
+  QCOMPARE(mRepo->lookupBlob(id).rawContent(), both);
+  QCOMPARE(size, static_cast<size_t>(both.size()));
+
+  index.add("hunks", id, size);
+  QCOMPARE(index.isStaged("hunks"), git::Index::Staged);
+}
+
+void TestIndex::applyHunks_data()
+{
+  QTest::addColumn<QByteArray>("base");
+  QTest::addColumn<QByteArray>("content");
+  QTest::addColumn<QString>("hunks");
+  QTest::addColumn<QByteArray>("expected");
+
+  QByteArray base = lines();
+  QByteArray prepended = "New 0\nNew 1\n" + base;
+  QByteArray inserted = base;
+  inserted.replace("Line 16\n", "Inserted 0\nInserted 1\nLine 16\n");
+  QByteArray both = "New 0\nNew 1\n" + inserted;
+
+  // Added lines keep their order at the start and in the middle.
+  QTest::newRow("prepend") << base << both << "10" << prepended;
+  QTest::newRow("insert") << base << both << "01" << inserted;
+  QTest::newRow("prepend and insert") << base << both << "11" << both;
+
+  QByteArray first = base;
+  first.replace("Line 2\nLine 3\n", "");
+  QByteArray last = base;
+  last.replace("Line 18\nLine 19\n", "");
+  QByteArray deleted = first;
+  deleted.replace("Line 18\nLine 19\n", "");
+
+  // Deleted lines aren't replaced.
+  QTest::newRow("delete") << base << deleted << "10" << first;
+  QTest::newRow("delete end") << base << deleted << "01" << last;
+  QTest::newRow("delete both") << base << deleted << "11" << deleted;
+
+  QByteArray open = lines(false);
+  QByteArray head = open;
+  head.replace("Line 2\n", "Line 2 changed\n");
+  QByteArray tail = open;
+  tail.replace("Line 19", "Line 19 changed");
+  QByteArray changed = head;
+  changed.replace("Line 19", "Line 19 changed");
+
+  // The last line stays without a newline.
+  QTest::newRow("no newline head") << open << changed << "10" << head;
+  QTest::newRow("no newline tail") << open << changed << "01" << tail;
+  QTest::newRow("no newline both") << open << changed << "11" << changed;
+}
+
+void TestIndex::applyHunks()
+{
+  QFETCH(QByteArray, base);
+  QFETCH(QByteArray, content);
+  QFETCH(QString, hunks);
+  QFETCH(QByteArray, expected);
+
+  // Each row tracks its own file.
+  QString name = QString("apply_%1").arg(QTest::currentDataTag());
+  name.replace(' ', '_');
+
+  QFile file(mRepo->workdir().filePath(name));
+  QVERIFY(file.open(QFile::WriteOnly));
+  file.write(base);
+  file.close();
+
+  git::Index index = mRepo->index();
+  index.setStaged({name}, true);
+
+  QVERIFY(file.open(QFile::WriteOnly));
+  file.write(content);
+  file.close();
+
+  git::Diff diff = mRepo->diffIndexToWorkdir(nullptr, {name});
+  QCOMPARE(diff.count(), 1);
+
+  git::Patch patch = diff.patch(0);
+  QCOMPARE(patch.count(), hunks.length());
+
+  QBitArray mask(hunks.length());
+  for (int i = 0; i < hunks.length(); ++i)
+    mask.setBit(i, hunks.at(i) == '1');
+
+  size_t size = 0;
+  git::Id id = patch.applyToOdb(mask, &size);
+  QVERIFY(!id.isNull());
+  QCOMPARE(mRepo->lookupBlob(id).rawContent(), expected);
+  QCOMPARE(size, static_cast<size_t>(expected.size()));
+}
+
 void TestIndex::cleanupTestCase()
 {
   mWindow->close();
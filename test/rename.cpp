@@ -0,0 +1,214 @@
+//
+//          Copyright (c) 2016, Scientific Toolworks, Inc.
+//
+// This software is licensed under the MIT License. The LICENSE.md file
+// describes the conditions under which this software may be distributed.
+//
+// Author: Jason Haslam
+//
+
+#include "Test.h"
+#include "git/Commit.h"
+#include "git/Diff.h"
+#include "git2/blob.h"
+#include "git2/commit.h"
+#include "git2/diff.h"
+#include "git2/repository.h"
+#include "git2/signature.h"
+#include "git2/tree.h"
+
+using namespace Test;
+using namespace QTest;
+
+namespace {
+
+const int kLineCount = 40;
+const int kLargeLineCount = 300;
+const int kRepeatedCount = 8;
+
+QByteArray lines(int changed, const QByteArray &indent = QByteArray())
+{
+  QByteArray content;
+  for (int i = 0; i < kLineCount; ++i) {
+    QByteArray number = QByteArray::number(i);
+    content += indent;
+    content += (i < changed) ?
+      "Line " + number + " was rewritten for the new version.\n" :
+      "Line " + number + " of the original file has some text.\n";
+  }
+
+  return content;
+}
+
+// Many distinct lines, each followed by one of a few lines that
+// repeat throughout every file, like closing braces.
+QByteArray boilerplate(const QByteArray &word, int changed = 0)
+{
+  QByteArray content;
+  for (int i = 0; i < kLargeLineCount; ++i) {
+    QByteArray number = QByteArray::number(i);
+    content += (i < changed) ?
+      "Line " + number + " was rewritten for the new version.\n" :
+      word + " line " + number + " has some distinct text.\n";
+    content += "} // end " + QByteArray::number(i % kRepeatedCount) + '\n';
+  }
+
+  return content;
+}
+
+} // anon. namespace
+
+class TestRename : public QObject
+{
+  Q_OBJECT
+
+private slots:
+  void initTestCase();
+  void similarity_data();
+  void similarity();
+  void cleanupTestCase();
+
+private:
+  // Commit a tree with a single file and return the commit id.
+  git_oid commit(
+    const char *name,
+    const QByteArray &content,
+    const git_oid *parent = nullptr);
+
+  ScratchRepository mRepo;
+  git_repository *mHandle = nullptr;
+};
+
+void TestRename::initTestCase()
+{
+  QByteArray path = mRepo->dir().path().toUtf8();
+  QCOMPARE(git_repository_open(&mHandle, path), 0);
+}
+
+void TestRename::similarity_data()
+{
+  QTest::addColumn<QByteArray>("base");
+  QTest::addColumn<QByteArray>("content");
+  QTest::addColumn<bool>("renamed");
+  QTest::addColumn<bool>("compare");
+
+  // Scores should agree with the default metric except for
+  // whitespace changes, which the cached metric ignores.
+  QTest::newRow("identical") << lines(0) << lines(0) << true << true;
+  QTest::newRow("edited") << lines(0) << lines(4) << true << true;
+  QTest::newRow("reindented") << lines(0) << lines(0, "    ") << true << false;
+  QTest::newRow("mostly rewritten") << lines(0) << lines(30) << false << true;
+  QTest::newRow("rewritten") << lines(0) << lines(kLineCount) << false << true;
+
+  // Sketches are truncated for files with more distinct lines. Lines
+  // that repeat in unrelated files must not fill the sketch.
+  QByteArray large = boilerplate("Alpha");
+  QTest::newRow("large edited")
+    << large << boilerplate("Alpha", 8) << true << true;
+  QTest::newRow("shared boilerplate")
+    << large << boilerplate("Omega") << false << false;
+}
+
+void TestRename::similarity()
+{
+  QFETCH(QByteArray, base);
+  QFETCH(QByteArray, content);
+  QFETCH(bool, renamed);
+  QFETCH(bool, compare);
+
+  git_oid parent = commit("old.txt", base);
+  git_oid child = commit("new.txt", content, &parent);
+
+  // Detect renames with the cached metric.
+  git::Commit commit = mRepo->lookupCommit(git::Id(child));
+  QVERIFY(commit.isValid());
+
+  git::Diff diff = commit.diff();
+  QVERIFY(diff.isValid());
+  QCOMPARE(diff.findSimilar(mRepo), renamed);
+  QCOMPARE(diff.count(), renamed ? 1 : 2);
+
+  // Signatures are cached now. Detect again from the cache.
+  git::Diff cached = commit.diff();
+  QCOMPARE(cached.findSimilar(mRepo), renamed);
+
+  if (!compare)
+    return;
+
+  // Detect renames with the default libgit2 metric.
+  git_commit *oldCommit = nullptr;
+  git_commit *newCommit = nullptr;
+  git_tree *oldTree = nullptr;
+  git_tree *newTree = nullptr;
+  QCOMPARE(git_commit_lookup(&oldCommit, mHandle, &parent), 0);
+  QCOMPARE(git_commit_lookup(&newCommit, mHandle, &child), 0);
+  QCOMPARE(git_commit_tree(&oldTree, oldCommit), 0);
+  QCOMPARE(git_commit_tree(&newTree, newCommit), 0);
+
+  git_diff *raw = nullptr;
+  QCOMPARE(
+    git_diff_tree_to_tree(&raw, mHandle, oldTree, newTree, nullptr), 0);
+
+  git_diff_find_options opts = GIT_DIFF_FIND_OPTIONS_INIT;
+  QCOMPARE(git_diff_find_similar(raw, &opts), 0);
+
+  bool found = false;
+  size_t count = git_diff_num_deltas(raw);
+  for (size_t i = 0; i < count; ++i) {
+    if (git_diff_get_delta(raw, i)->status == GIT_DELTA_RENAMED)
+      found = true;
+  }
+
+  git_diff_free(raw);
+  git_tree_free(newTree);
+  git_tree_free(oldTree);
+  git_commit_free(newCommit);
+  git_commit_free(oldCommit);
+
+  QCOMPARE(found, renamed);
+}
+
+void TestRename::cleanupTestCase()
+{
+  git_repository_free(mHandle);
+}
+
+git_oid TestRename::commit(
+  const char *name,
+  const QByteArray &content,
+  const git_oid *parent)
+{
+  git_oid blob, tree, id;
+  git_blob_create_frombuffer(
+    &blob, mHandle, content.constData(), content.size());
+
+  git_treebuilder *builder = nullptr;
+  git_treebuilder_new(&builder, mHandle, nullptr);
+  git_treebuilder_insert(nullptr, builder, name, &blob, GIT_FILEMODE_BLOB);
+  git_treebuilder_write(&tree, builder);
+  git_treebuilder_free(builder);
+
+  git_tree *obj = nullptr;
+  git_tree_lookup(&obj, mHandle, &tree);
+
+  git_commit *parentCommit = nullptr;
+  if (parent)
+    git_commit_lookup(&parentCommit, mHandle, parent);
+
+  git_signature *sig = nullptr;
+  git_signature_now(&sig, "Test", "test@example.com");
+
+  const git_commit *parents[] = {parentCommit};
+  git_commit_create(
+    &id, mHandle, nullptr, sig, sig, nullptr, name, obj,
+    parentCommit ? 1 : 0, parents);
+
+  git_signature_free(sig);
+  git_commit_free(parentCommit);
+  git_tree_free(obj);
+  return id;
+}
+
+TEST_MAIN(TestRename)
+
+#include "rename.moc"
@@ -0,0 +1,129 @@
+//
+//          Copyright (c) 2016, Scientific Toolworks, Inc.
+//
+// This software is licensed under the MIT License. The LICENSE.md file
+// describes the conditions under which this software may be distributed.
+//
+// Author: Jason Haslam
+//
+
+#include "Test.h"
+#include "ui/WordDiff.h"
+
+using namespace QTest;
+
+namespace {
+
+const QByteArray kWordChars =
+  "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_";
+const QByteArray kSpaceChars = " \t";
+
+// Diff the first two lines of text.
+WordDiff::Result diff(const QByteArray &text)
+{
+  return WordDiff(kWordChars, kSpaceChars).diff(text, {{0, 1}});
+}
+
+void verify(const QVector<WordDiff::Range> &ranges, int pos, int length)
+{
+  QCOMPARE(ranges.size(), 1);
+  QCOMPARE(ranges.first().pos, pos);
+  QCOMPARE(ranges.first().length, length);
+}
+
+} // anon. namespace
+
+class TestWordDiff : public QObject
+{
+  Q_OBJECT
+
+private slots:
+  void insertion();
+  void deletion();
+  void replacement();
+  void crlf();
+  void cr();
+  void emptySide();
+  void editLimit();
+};
+
+void TestWordDiff::insertion()
+{
+  WordDiff::Result result = diff("foo bar\nfoo baz bar\n");
+  QVERIFY(result.deletions.isEmpty());
+  verify(result.additions, 12, 4);
+}
+
+void TestWordDiff::deletion()
+{
+  WordDiff::Result result = diff("foo baz bar\nfoo bar\n");
+  verify(result.deletions, 4, 4);
+  QVERIFY(result.additions.isEmpty());
+}
+
+void TestWordDiff::replacement()
+{
+  WordDiff::Result result = diff("int x = 1;\nint y = 1;\n");
+  verify(result.deletions, 4, 1);
+  verify(result.additions, 15, 1);
+}
+
+void TestWordDiff::crlf()
+{
+  // Line endings aren't part of the last token.
+  WordDiff::Result result = diff("foo bar\r\nfoo baz\r\n");
+  verify(result.deletions, 4, 3);
+  verify(result.additions, 13, 3);
+}
+
+void TestWordDiff::cr()
+{
+  // A lone carriage return ends a line like it does in the editor.
+  WordDiff::Result result = diff("foo bar\rfoo baz\r");
+  verify(result.deletions, 4, 3);
+  verify(result.additions, 12, 3);
+}
+
+void TestWordDiff::emptySide()
+{
+  WordDiff::Result result = diff("foo\n\n");
+  verify(result.deletions, 0, 3);
+  QVERIFY(result.additions.isEmpty());
+
+  result = diff("\nfoo\n");
+  QVERIFY(result.deletions.isEmpty());
+  verify(result.additions, 1, 3);
+}
+
+void TestWordDiff::editLimit()
+{
+  // Every other token changes. A small line gets separate ranges.
+  QList<QByteArray> oldWords;
+  QList<QByteArray> newWords;
+  for (int i = 0; i < 20; ++i) {
+    oldWords.append("w" + QByteArray::number(i));
+    newWords.append("w" + QByteArray::number(i) + "x");
+  }
+
+  QByteArray oldLine = oldWords.join(' ');
+  QByteArray newLine = newWords.join(' ');
+  WordDiff::Result result = diff(oldLine + '\n' + newLine + '\n');
+  QCOMPARE(result.deletions.size(), 20);
+  QCOMPARE(result.additions.size(), 20);
+
+  // Too many edits fall back to highlighting the whole line.
+  for (int i = 20; i < 300; ++i) {
+    oldWords.append("w" + QByteArray::number(i));
+    newWords.append("w" + QByteArray::number(i) + "x");
+  }
+
+  oldLine = oldWords.join(' ');
+  newLine = newWords.join(' ');
+  result = diff(oldLine + '\n' + newLine + '\n');
+  verify(result.deletions, 0, oldLine.size());
+  verify(result.additions, oldLine.size() + 1, newLine.size());
+}
+
+TEST_MAIN(TestWordDiff)
+
+#include "word_diff.moc"